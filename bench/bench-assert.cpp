@@ -0,0 +1,99 @@
+/* vim: set sw=4 ts=4 et : */
+/* bench-assert.cpp: cost of assertResult on the passing and failing paths
+ *
+ * Copyright (C) 2014 Alexandre Moreno
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * The output mode is picked the same way as in tests, defining MATCHA_GTEST
+ * or MATCHA_BOOSTTEST, so this is built once for each of them
+ *
+ */
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#if defined(MATCHA_BOOSTTEST)
+#define BOOST_TEST_NO_MAIN
+#endif
+#include "matcha/matcha.hpp"
+
+using namespace matcha;
+
+#if defined(MATCHA_GTEST)
+typedef ::testing::AssertionResult result_type;
+#elif defined(MATCHA_BOOSTTEST)
+typedef boost::test_tools::predicate_result result_type;
+#else
+typedef bool result_type;
+
+// failures are reported by a writer thread, which would flood the console
+static const bool quiet = (set_report_sink([](std::string const&) { }), true);
+#endif
+
+// what a passing assertThat(x, equalTo(y)) is measured against
+static void BM_BareEquality(benchmark::State& state) {
+    int x = 42, y = 42;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(x);
+        bool result = x == y;
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_BareEquality);
+
+static void BM_AssertPass(benchmark::State& state) {
+    int x = 42;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(x);
+        auto result = assertResult<result_type>(x, equalTo(42));
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_AssertPass);
+
+static void BM_AssertFail(benchmark::State& state) {
+    int x = 41;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(x);
+        auto result = assertResult<result_type>(x, equalTo(42));
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_AssertFail);
+
+// most of a failure is formatting the description of nested matchers
+static void BM_AssertFailComposite(benchmark::State& state) {
+    double x = 0.375;
+    auto const matcher = anyOf(allOf(greaterThan(0.5), lessThan(0.75)), is(not(closeTo(0.375, 0.125))),
+                               equalTo(1.0 / 3));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(x);
+        auto result = assertResult<result_type>(x, matcher);
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_AssertFailComposite);
+
+static void BM_AssertFailContainer(benchmark::State& state) {
+    std::vector<int> const expected(state.range(0), 1);
+    std::vector<int> actual = expected;
+    actual.back() = 2;
+    for (auto _ : state) {
+        auto result = assertResult<result_type>(actual, equalTo(expected));
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(state.iterations() * actual.size());
+}
+BENCHMARK(BM_AssertFailContainer)->RangeMultiplier(10)->Range(1, 100000000);
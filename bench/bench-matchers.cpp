@@ -0,0 +1,163 @@
+/* vim: set sw=4 ts=4 et : */
+/* bench-matchers.cpp: Google Benchmark suite of the matchers
+ *
+ * Copyright (C) 2014 Alexandre Moreno
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Each benchmark is run over input sizes from 1 to 10^8 items, except where
+ * building the input that large wouldn't fit in memory
+ *
+ */
+#include <string>
+#include <vector>
+#include <numeric>
+
+#include "benchmark/benchmark.h"
+#include "matcha/matcha.hpp"
+
+using namespace matcha;
+
+static void sizes(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(10)->Range(1, 100000000);
+}
+
+// one hashed index entry takes tens of bytes
+static void indexSizes(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(10)->Range(1, 1000000);
+}
+
+template<class Matcher, class T>
+static void run(benchmark::State& state, Matcher const& matcher, T const& actual, std::size_t items) {
+    for (auto _ : state) {
+        bool result = matcher.matches(actual);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(state.iterations() * items);
+}
+
+static std::vector<int> iota(std::size_t n) {
+    std::vector<int> v(n);
+    std::iota(v.begin(), v.end(), 0);
+    return v;
+}
+
+static void BM_EqualToScalar(benchmark::State& state) {
+    int x = 42;
+    benchmark::DoNotOptimize(x);
+    run(state, equalTo(42), x, 1);
+}
+BENCHMARK(BM_EqualToScalar);
+
+static void BM_EqualToVector(benchmark::State& state) {
+    std::vector<int> const actual = iota(state.range(0));
+    run(state, equalTo(actual), actual, actual.size());
+}
+BENCHMARK(BM_EqualToVector)->Apply(sizes);
+
+static void BM_ContainsItem(benchmark::State& state) {
+    std::vector<int> const actual = iota(state.range(0));
+    run(state, contains(int(actual.size()) - 1), actual, actual.size());
+}
+BENCHMARK(BM_ContainsItem)->Apply(sizes);
+
+static void BM_ContainsSubstring(benchmark::State& state) {
+    std::string const actual = std::string(state.range(0), 'a') + "needle";
+    run(state, contains(std::string("needle")), actual, actual.size());
+}
+BENCHMARK(BM_ContainsSubstring)->Apply(sizes);
+
+static void BM_ContainsAnyOf(benchmark::State& state) {
+    std::string const actual = std::string(state.range(0), 'a') + "fatal";
+    run(state, containsAnyOf({"error", "fatal", "panic", "abort"}), actual, actual.size());
+}
+BENCHMARK(BM_ContainsAnyOf)->Apply(sizes);
+
+static void BM_In(benchmark::State& state) {
+    std::vector<int> const candidates = iota(state.range(0));
+    run(state, in(candidates), int(candidates.size()) - 1, 1);
+}
+BENCHMARK(BM_In)->Apply(indexSizes);
+
+static void BM_OneOf(benchmark::State& state) {
+    run(state, oneOf(2, 3, 5, 7, 11, 13), 13, 1);
+}
+BENCHMARK(BM_OneOf);
+
+static void BM_MatchesPattern(benchmark::State& state) {
+    std::string const actual = std::string(state.range(0), '7');
+    run(state, matchesPattern("[0-9]+"), actual, actual.size());
+}
+// libstdc++'s std::regex recurses once per character, overflowing the stack
+// on much longer strings
+BENCHMARK(BM_MatchesPattern)->RangeMultiplier(10)->Range(1, 10000);
+
+static void BM_EqualToIgnoringCase(benchmark::State& state) {
+    std::string const actual(state.range(0), 'a');
+    std::string const expected(state.range(0), 'A');
+    run(state, equalToIgnoringCase(expected), actual, actual.size());
+}
+BENCHMARK(BM_EqualToIgnoringCase)->Apply(sizes);
+
+static void BM_EveryItem(benchmark::State& state) {
+    std::vector<float> const actual(state.range(0), 0.5f);
+    run(state, everyItem(allOf(greaterThan(0.f), lessThan(1.f))), actual, actual.size());
+}
+BENCHMARK(BM_EveryItem)->Apply(sizes);
+
+static void BM_EveryItemParallel(benchmark::State& state) {
+    std::vector<float> const actual(state.range(0), 0.5f);
+    run(state, everyItem(allOf(greaterThan(0.f), lessThan(1.f)), par), actual, actual.size());
+}
+BENCHMARK(BM_EveryItemParallel)->Apply(sizes)->UseRealTime();
+
+static void BM_CloseToEach(benchmark::State& state) {
+    std::vector<double> const expected(state.range(0), 0.5);
+    std::vector<double> const actual(state.range(0), 0.5 + 1e-12);
+    run(state, closeTo(expected, 1e-9), actual, actual.size());
+}
+BENCHMARK(BM_CloseToEach)->Apply(sizes);
+
+static void BM_WithinUlps(benchmark::State& state) {
+    std::vector<double> const expected(state.range(0), 0.5);
+    std::vector<double> const actual(state.range(0), std::nextafter(0.5, 1.0));
+    run(state, withinUlps(expected, 4), actual, actual.size());
+}
+BENCHMARK(BM_WithinUlps)->Apply(sizes);
+
+static void BM_IncrementalFeed(benchmark::State& state) {
+    // every item is matched by each operand, none of them settling early
+    auto monitor = incremental<int>(allOf(everyItem(greaterThan(-1)), isSorted(), not(contains(-1))));
+    int item = 0;
+    for (auto _ : state) {
+        verdict v = monitor.feed(item++);
+        benchmark::DoNotOptimize(v);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IncrementalFeed);
+
+static void BM_AnyOfNest(benchmark::State& state) {
+    // the last alternative matches, so every one is evaluated
+    auto const matcher = anyOf(equalTo(1), anyOf(equalTo(2), anyOf(equalTo(3), anyOf(equalTo(4),
+                         allOf(greaterThan(4), lessThan(6))))));
+    run(state, matcher, 5, 1);
+}
+BENCHMARK(BM_AnyOfNest);
+
+static void BM_AllOfNest(benchmark::State& state) {
+    auto const matcher = allOf(greaterThan(0), allOf(lessThan(10), allOf(not(equalTo(3)),
+                         allOf(not(equalTo(4)), anyOf(equalTo(5), equalTo(6))))));
+    run(state, matcher, 5, 1);
+}
+BENCHMARK(BM_AllOfNest);
@@ -0,0 +1,85 @@
+#!/bin/sh
+# compile-time.sh: compile time and object size of anyOf/allOf compositions
+#
+# usage: compile-time.sh [-s <dialect>] <c++ compiler> <matcha include dir> <results.json> [sizes...]
+#
+# For each size N, two translation units are generated and compiled as a
+# debug build would be, in the given -std dialect, c++11 by default:
+#  deep: N levels of allOf and anyOf alternating, which can't be flattened
+#  wide: one anyOf of N operands
+# The results are written as a JSON array, one record per translation unit.
+
+set -e
+
+DIALECT=c++11
+while getopts s: option; do
+    case $option in
+        s) DIALECT=$OPTARG ;;
+        *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+CXX=$1
+INCLUDE=$2
+OUT=$3
+shift 3
+SIZES=${*:-1 2 4 8 16 32 64}
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+deep() {
+    expr="equalTo(0)"
+    i=1
+    while [ "$i" -lt "$1" ]; do
+        if [ $((i % 2)) -eq 0 ]; then
+            expr="anyOf(equalTo($i), $expr)"
+        else
+            expr="allOf(greaterThan(-$i), $expr)"
+        fi
+        i=$((i + 1))
+    done
+    echo "$expr"
+}
+
+wide() {
+    expr="equalTo(0)"
+    i=1
+    while [ "$i" -lt "$1" ]; do
+        expr="$expr, equalTo($i)"
+        i=$((i + 1))
+    done
+    echo "anyOf($expr)"
+}
+
+now() {
+    date +%s%N
+}
+
+echo "[" > "$OUT"
+first=1
+for n in $SIZES; do
+    for shape in deep wide; do
+        src="$WORK/$shape-$n.cpp"
+        {
+            echo '#include "matcha/matcha.hpp"'
+            echo 'using namespace matcha;'
+            echo "bool check(int x) { return assertResult<bool>(x, $($shape "$n")); }"
+        } > "$src"
+
+        start=$(now)
+        "$CXX" -std="$DIALECT" -O0 -g -I"$INCLUDE" -I"$INCLUDE/matcha" -c "$src" -o "$WORK/$shape-$n.o"
+        end=$(now)
+
+        ms=$(( (end - start) / 1000000 ))
+        bytes=$(wc -c < "$WORK/$shape-$n.o" | tr -d ' ')
+        echo "$shape $n ($DIALECT): ${ms} ms, ${bytes} bytes"
+
+        [ "$first" -eq 1 ] || echo "," >> "$OUT"
+        first=0
+        printf '  {"shape": "%s", "size": %s, "dialect": "%s", "compile_ms": %s, "object_bytes": %s}' \
+            "$shape" "$n" "$DIALECT" "$ms" "$bytes" >> "$OUT"
+    done
+done
+printf '\n]\n' >> "$OUT"
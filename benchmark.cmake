@@ -0,0 +1,33 @@
+########################### GOOGLE BENCHMARK
+# Enable ExternalProject CMake module
+INCLUDE(ExternalProject)
+
+# Set default ExternalProject root directory
+SET_DIRECTORY_PROPERTIES(PROPERTIES EP_PREFIX ${CMAKE_BINARY_DIR}/ext)
+
+# Add benchmark, at the last release building as C++11
+ExternalProject_Add(
+    googlebenchmark
+    GIT_REPOSITORY https://github.com/google/benchmark.git
+    GIT_TAG v1.7.1
+    TIMEOUT 10
+    CMAKE_ARGS -DCMAKE_BUILD_TYPE=Release
+               -DBENCHMARK_ENABLE_TESTING=OFF
+               -DBENCHMARK_ENABLE_GTEST_TESTS=OFF
+    # Disable updating
+    UPDATE_COMMAND ""
+    # Disable install step
+    INSTALL_COMMAND ""
+    # Wrap download, configure and build steps in a script to log output
+    LOG_DOWNLOAD ON
+    LOG_CONFIGURE ON
+    LOG_BUILD ON)
+
+# Specify include dir
+ExternalProject_Get_Property(googlebenchmark source_dir)
+set(BENCHMARK_INCLUDE_DIR ${source_dir}/include CACHE INTERNAL "Path to include folder for benchmark")
+
+# Libraries
+ExternalProject_Get_Property(googlebenchmark binary_dir)
+set(BENCHMARK_LIBRARY_PATH ${binary_dir}/src/${CMAKE_FIND_LIBRARY_PREFIXES}benchmark.a CACHE INTERNAL "Path to benchmark library")
+set(BENCHMARK_MAIN_LIBRARY_PATH ${binary_dir}/src/${CMAKE_FIND_LIBRARY_PREFIXES}benchmark_main.a CACHE INTERNAL "Path to benchmark_main library")
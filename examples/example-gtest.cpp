@@ -20,10 +20,13 @@
  *
  */
 #include <iostream>
+#include <cstdlib>
 #include <string>
 #include <vector>
 #include <set>
 #include <map>
+#include <sstream>
+#include <iterator>
 #include <array>
 #define MATCHA_GTEST
 #include "matcha/matcha.hpp"
@@ -112,6 +115,11 @@ TEST(Matcha, testNullPointers) {
     assertThat(p, is(null()));
 }
 
+TEST(Matcha, testStringSlice) {
+    const char request[] = "GET /index.html HTTP/1.1";
+    assertThat(string_ref(request + 4, 11), endsWith(".htm"));
+}
+
 TEST(Matcha, testStringStartWith) {
     assertThat("myStringOfNote", startsWith("you"));
 }
@@ -147,6 +155,110 @@ TEST(Matcha, testStringEveryItem) {
     assertThat(vs, everyItem(matches("^192\\.168\\.0\\.[1-3]$")));
 }
 
+TEST(Matcha, testAdaptiveAllOf) {
+    std::vector<std::string> vs(10000, "10.0.0.1");
+    vs.back() = "10.0.0.1 ";
+    assertThat(vs, everyItem(adaptive(allOf(matchesPattern("[0-9.]+"), startsWith("10."), endsWith("1")))));
+}
+
+TEST(Matcha, testAnyMatcher) {
+    std::vector<AnyMatcher<std::string>> rules;
+    rules.push_back(startsWith("10."));
+    rules.push_back(anyOf(endsWith(".1"), endsWith(".254")));
+    rules.push_back(matchesPattern("([0-9]{1,3}\\.){3}[0-9]{1,3}"));
+    for (auto const& rule : rules)
+        assertThat("10.0.0.12", rule);
+}
+
+TEST(Matcha, testReferencedExpectedValue) {
+    std::vector<int> golden(100000, 3);
+    std::vector<int> v(golden);
+    assertThat(v, is(not(equalTo(cref(golden)))));
+}
+
+TEST(Matcha, testEveryItemOfStream) {
+    std::istringstream records("17 4 9 -2 11 8");
+    assertThat(inputRange(std::istream_iterator<int>(records), std::istream_iterator<int>()),
+               everyItem(greaterThan(0)));
+}
+
+TEST(Matcha, testSizeOfGenerated) {
+    int next = 0;
+    auto firstFive = [&next](int& item) { item = next++; return item < 5; };
+    assertThat(inputRange<int>(firstFive), hasSize(4));
+}
+
+TEST(Matcha, testFileLines) {
+    assertThat(fileContents(__FILE__).lines(), everyItem(not(endsWith(";"))));
+}
+
+TEST(Matcha, testSnapshot) {
+    // recorded out of the working directory by the first assertion, which
+    // the second is then checked against
+    char const* tmp = std::getenv("TMPDIR");
+    ::setenv("MATCHA_SNAPSHOT_DIR", (std::string(tmp ? tmp : "/tmp") + "/matcha-example-snapshots").c_str(), 1);
+    std::vector<int> primes = {2, 3, 5, 7, 11};
+    assertThat(primes, matchesSnapshot("first-primes"));
+    primes.back() = 9;
+    assertThat(primes, matchesSnapshot("first-primes"));
+}
+
+TEST(Matcha, testContainsInAnyOrder) {
+    std::vector<int> shards = {5, 3, 8, 3};
+    assertThat(shards, containsInAnyOrder(3, 5, 8));
+    assertThat(shards, sameElementsAs(std::vector<int>{3, 3, 5, 8}));
+}
+
+TEST(Matcha, testContainsAnyOf) {
+    std::string log = "fatal: disk full";
+    assertThat(log, containsAnyOf({"error", "fatal", "panic"}));
+    assertThat(log, containsAllOf({"disk", "error"}));
+}
+
+TEST(Matcha, testElementwiseCloseTo) {
+    std::vector<double> reference = {1.0, 2.0, 3.0};
+    std::vector<double> output = {1.0, 2.0000001, 3.5};
+    assertThat(output, closeTo(reference, 1e-6));
+    assertThat(output, withinUlps(reference, 4));
+}
+
+TEST(Matcha, testWithinUlpsAcrossZero) {
+    // of opposite signs, 4278190078 ulps apart, compared in vectors
+    float const top = std::numeric_limits<float>::max();
+    assertThat(std::vector<float>(64, -top), withinUlps(std::vector<float>(64, top), 1u << 25));
+}
+
+TEST(Matcha, testIsSorted) {
+    std::vector<int> timestamps = {1, 3, 3, 8, 5, 13};
+    assertThat(timestamps, isSorted());
+}
+
+TEST(Matcha, testIncrementalStream) {
+    auto monitor = incremental<int>(allOf(everyItem(greaterThan(0)), isSorted()));
+    for (int timestamp : {3, 5, 8, 7, 9})
+        monitor.feed(timestamp);
+    monitor.finish();
+    assertThat(monitor, holds());
+}
+
+TEST(Matcha, testEveryItemInRange) {
+    std::vector<float> samples(8, 0.5f);
+    samples[5] = 1.5f;
+    assertThat(samples, everyItem(allOf(greaterThan(0.f), lessThan(1.f))));
+}
+
+TEST(Matcha, testEveryItemInParallel) {
+    std::vector<int> ids(16, 7);
+    ids[10] = -1;
+    assertThat(ids, everyItem(greaterThan(0), parallel_policy(8)));
+}
+
+TEST(Matcha, testSoftAssertions) {
+    MatchaCollector failures;
+    for (int i = 0; i < 1000; ++i)
+        checkThat(i % 250, lessThan(249));
+    failures.discard_repeated();
+}
 
 TEST(Matcha, testStringIgnoreCase) {
     assertThat("foo", is(equalToIgnoringCase("Foo")));
@@ -160,6 +272,16 @@ TEST(Matcha, testRegex) {
     assertThat("12345a", matchesPattern("[0-9]+"));
 }
 
+struct Digits { static const char* value() { return "[0-9]+"; } };
+TEST(Matcha, testStaticRegex) {
+    assertThat("12345a", matchesPattern<Digits>());
+}
+
+// checked by the compiler, so there is nothing left to run
+constexpr std::array<int, 5> primes = {{ 2, 3, 5, 7, 11 }};
+static_assertThat(7, is(in(primes)));
+static_assertThat(0.98, is(closeTo(1.0, 0.03)));
+
 TEST(Matcha, testCloseTo) {
     assertThat(0.98, is(closeTo(1.0, 0.03)));
     assertThat(0.98f, is(closeTo(1.0f, 0.03f)));
@@ -0,0 +1,44 @@
+/* vim: set sw=4 ts=4 et : */
+/* matcha-fwd.hpp: declarations of the matcha types, for headers which only
+ * name them, e.g. test helpers returning a matcher, so that they don't have
+ * to include matcha.hpp
+ *
+ *   matcha::AnyMatcher<Order> isShipped();
+ *
+ * Copyright (C) 2014 Alexandre Moreno
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _MATCHA_FWD_H_
+#define _MATCHA_FWD_H_
+
+namespace matcha {
+
+class writer;
+class string_ref;
+
+template<typename T>
+class array_ref;
+
+template<class MatcherPolicy, class ExpectedType = void>
+class Matcher;
+
+template<typename T>
+class AnyMatcher;
+
+class MatchaCollector;
+
+} // namespace matcha
+
+#endif // _MATCHA_FWD_H_
@@ -0,0 +1,655 @@
+/* vim: set sw=4 ts=4 et : */
+/* matcha-inl.hpp: the parts of matcha which don't depend on the types under
+ * test, included by matcha.hpp unless MATCHA_LIBRARY is defined, and else
+ * compiled once into libmatcha by src/matcha.cpp
+ *
+ * Copyright (C) 2014 Alexandre Moreno
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _MATCHA_INL_H_
+#define _MATCHA_INL_H_
+
+#include "matcha.hpp"
+
+#include <regex>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+
+#if defined(MATCHA_POSIX)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#if defined(MATCHA_MMAP)
+#include <sys/mman.h>
+#endif
+
+namespace matcha {
+
+namespace detail {
+
+// multiple producer, single consumer queue of records (D. Vyukov's): pushing
+// is one exchange, and the single reader follows the links from the oldest
+class report_queue {
+public:
+    struct node {
+        std::atomic<node*> next;
+        std::string record;
+    };
+
+    report_queue() : head_(&stub_), tail_(&stub_) {
+        stub_.next.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~report_queue() {
+        while (node* n = pop())
+            delete n;
+    }
+
+    void push(node* n) {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        node* prev = head_.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    // the oldest record, or null when there is none or it is still being linked
+    node* pop() {
+        node* tail = tail_;
+        node* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_) {
+            if (!next)
+                return nullptr;
+            tail_ = tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        if (tail != head_.load(std::memory_order_acquire))
+            return nullptr;
+        push(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+private:
+    std::atomic<node*> head_;
+    node* tail_;
+    node stub_;
+};
+
+class reporter {
+public:
+    reporter() : sink_(stdout_sink()), stop_(false), waiting_(false), published_(0), written_(0) {
+        writer_ = std::thread([this] { write(); });
+    }
+
+    ~reporter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        writer_.join();
+    }
+
+    reporter(reporter const&) = delete;
+    reporter& operator=(reporter const&) = delete;
+
+    void publish(std::string record) {
+        report_queue::node* n = new report_queue::node;
+        n->record.swap(record);
+        published_.fetch_add(1);
+        queue_.push(n);
+        if (waiting_.load()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            wake_.notify_one();
+        }
+    }
+
+    void sink(report_sink s) {
+        std::lock_guard<std::mutex> lock(sink_mutex_);
+        sink_ = std::move(s);
+    }
+
+    // waits until every record published so far has been written
+    void flush() {
+        unsigned long const target = published_.load();
+        std::unique_lock<std::mutex> lock(mutex_);
+        written_cv_.wait(lock, [this, target] { return written_ >= target; });
+    }
+
+private:
+    void write() {
+        for (;;) {
+            unsigned long done = 0;
+            {
+                std::lock_guard<std::mutex> lock(sink_mutex_);
+                while (report_queue::node* n = queue_.pop()) {
+                    std::unique_ptr<report_queue::node> record(n);
+                    if (sink_)
+                        sink_(record->record);
+                    ++done;
+                }
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (done) {
+                written_ += done;
+                written_cv_.notify_all();
+                continue;
+            }
+            if (stop_ && written_ == published_.load())
+                return;
+
+            // a record pushed after waiting_ is set is seen by the wait's
+            // check, or its producer takes the lock to wake us up
+            waiting_.store(true);
+            wake_.wait(lock, [this] { return stop_ || written_ != published_.load(); });
+            waiting_.store(false);
+        }
+    }
+
+    report_queue queue_;
+    std::mutex sink_mutex_;
+    report_sink sink_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable written_cv_;
+    bool stop_;
+    std::atomic<bool> waiting_;
+    std::atomic<unsigned long> published_;
+    unsigned long written_;
+    std::thread writer_;
+};
+
+MATCHA_INLINE reporter& default_reporter() {
+    static reporter r;
+    return r;
+}
+
+MATCHA_INLINE void publish_report(std::string record) {
+    default_reporter().publish(std::move(record));
+}
+
+} // namespace detail
+
+MATCHA_INLINE void set_report_sink(report_sink sink) {
+    detail::default_reporter().sink(std::move(sink));
+}
+
+MATCHA_INLINE void flush_reports() {
+    detail::default_reporter().flush();
+}
+
+namespace detail {
+
+MATCHA_INLINE file_bytes::file_bytes(std::string const& path) : data_(nullptr), size_(0), mapped_(false) {
+#if defined(MATCHA_MMAP)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("matcha: cannot open " + path);
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            data_ = static_cast<char const*>(p);
+            size_ = std::size_t(st.st_size);
+            mapped_ = true;
+            ::madvise(p, size_, MADV_SEQUENTIAL);
+        }
+    }
+    if (!mapped_) {
+        char chunk[64 * 1024];
+        ssize_t n;
+        while ((n = ::read(fd, chunk, sizeof chunk)) > 0)
+            buffer_.append(chunk, std::size_t(n));
+    }
+    ::close(fd);
+#else
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        throw std::runtime_error("matcha: cannot open " + path);
+    char chunk[64 * 1024];
+    std::size_t n;
+    while ((n = std::fread(chunk, 1, sizeof chunk, file)) > 0)
+        buffer_.append(chunk, n);
+    std::fclose(file);
+#endif
+    if (!mapped_) {
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+    }
+}
+
+MATCHA_INLINE file_bytes::~file_bytes() {
+#if defined(MATCHA_MMAP)
+    if (mapped_)
+        ::munmap(const_cast<char*>(data_), size_);
+#endif
+}
+
+
+/*
+ * snapshots on disk: each one's data in <directory>/<id>.snap, and the hash
+ * of all of them in <directory>/index, read once per process so that a
+ * matching snapshot is checked without reading its data. The data files are
+ * what a snapshot is: the index keeps the size and modification time each
+ * hash was taken at, and a data file which has changed since, or which the
+ * index is missing, is read and its entry taken again. Files are written
+ * under names of their own and renamed into place, and the index is
+ * rewritten merged with the one on disk while holding <directory>/index.lock,
+ * so that processes recording side by side keep each other's entries. It is
+ * written sorted by id, for it to diff well.
+ */
+class snapshot_store {
+public:
+    // of a data file, as it was when hashed; the time in nanoseconds
+    struct stamp {
+        std::uint64_t size;
+        std::int64_t mtime;
+
+        bool operator==(stamp const& other) const {
+            return size == other.size && mtime == other.mtime;
+        }
+    };
+
+    struct entry {
+        stamp file;
+        std::uint64_t hash;
+    };
+
+    explicit snapshot_store(std::string directory, bool update = false)
+        : directory_(std::move(directory)), update_(update), loaded_(false)
+    { }
+
+    std::string data_path(std::string const& id) const {
+        return directory_ + "/" + id + ".snap";
+    }
+
+    bool updating() const {
+        return update_;
+    }
+
+    // the stamp of the data file of id, if there is one
+    bool data_stamp(std::string const& id, stamp& found) const {
+        return stat_file(data_path(id), found);
+    }
+
+    bool find(std::string const& id, entry& found) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        load();
+        auto it = index_.find(id);
+        if (it == index_.end())
+            return false;
+        found = it->second;
+        return true;
+    }
+
+    // throws std::runtime_error when the directory can't be written to
+    void record(std::string const& id, string_ref data) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        load();
+#if defined(MATCHA_POSIX)
+        ::mkdir(directory_.c_str(), 0777);
+#endif
+        std::string const path = data_path(id);
+        replace_file(path, data);
+        index_entry(id, path, data);
+    }
+
+    // the index entry of data read from the data file of id
+    void restore(std::string const& id, string_ref data) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        load();
+        index_entry(id, data_path(id), data);
+    }
+
+private:
+    void load() {
+        if (loaded_)
+            return;
+        loaded_ = true;
+        read_index();
+    }
+
+    void index_entry(std::string const& id, std::string const& path, string_ref data) {
+        entry e = { { data.size(), 0 }, hash_bytes(data.data(), data.size()) };
+        stat_file(path, e.file);
+        index_[id] = e;
+        write_index(id);
+    }
+
+    // lines of "<hash> <size> <mtime> <id>", the entries already known kept
+    void read_index() {
+        std::FILE* file = std::fopen((directory_ + "/index").c_str(), "r");
+        if (!file)
+            return;
+        char line[4096];
+        while (std::fgets(line, sizeof line, file)) {
+            unsigned long long hash, size;
+            long long mtime;
+            int id = 0;
+            if (std::sscanf(line, "%llx %llu %lld %n", &hash, &size, &mtime, &id) != 3 || id == 0)
+                continue;
+            std::string name(line + id);
+            while (!name.empty() && (name.back() == '\n' || name.back() == '\r'))
+                name.pop_back();
+            index_.insert(std::make_pair(name, entry{stamp{size, mtime}, hash}));
+        }
+        std::fclose(file);
+    }
+
+    // merged, under the lock, with the entries other processes have
+    // written since it was read, but for the one of id just taken
+    void write_index(std::string const& id) {
+        index_lock lock(directory_ + "/index.lock");
+        entry const taken = index_[id];
+        read_index();
+        index_[id] = taken;
+        writer o;
+        for (auto const& e : index_) {
+            char hash[17];
+            std::snprintf(hash, sizeof hash, "%016llx", static_cast<unsigned long long>(e.second.hash));
+            o << hash << " " << e.second.file.size << " " << e.second.file.mtime << " " << e.first << "\n";
+        }
+        replace_file(directory_ + "/index", o.str());
+    }
+
+    // an advisory lock of a file, held for the life of the object, where
+    // there are such locks
+    class index_lock {
+    public:
+        explicit index_lock(std::string const& path) {
+#if defined(MATCHA_POSIX)
+            fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0666);
+            if (fd_ >= 0)
+                while (::lockf(fd_, F_LOCK, 0) != 0 && errno == EINTR)
+                    ;
+#else
+            (void)path;
+#endif
+        }
+
+        ~index_lock() {
+#if defined(MATCHA_POSIX)
+            if (fd_ >= 0)
+                ::close(fd_);
+#endif
+        }
+
+    private:
+        index_lock(index_lock const&);
+        index_lock& operator=(index_lock const&);
+
+#if defined(MATCHA_POSIX)
+        int fd_;
+#endif
+    };
+
+    static bool stat_file(std::string const& path, stamp& found) {
+#if defined(MATCHA_POSIX)
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0)
+            return false;
+        found.size = std::uint64_t(st.st_size);
+#if defined(__APPLE__)
+        found.mtime = std::int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        found.mtime = std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+        return true;
+#else
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+        std::fseek(file, 0, SEEK_END);
+        found.size = std::uint64_t(std::ftell(file));
+        found.mtime = 0;
+        std::fclose(file);
+        return true;
+#endif
+    }
+
+    // written next to path under a name of this process's, then renamed
+    // over it, so that no one reads it half written
+    static void replace_file(std::string const& path, string_ref data) {
+#if defined(MATCHA_POSIX)
+        std::string const temporary = path + "." + std::to_string(::getpid()) + ".tmp";
+#else
+        std::string const temporary = path + "." + std::to_string(
+            std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+#endif
+        std::FILE* file = std::fopen(temporary.c_str(), "wb");
+        bool const written = file
+            && std::fwrite(data.data(), 1, data.size(), file) == data.size();
+        if (file && std::fclose(file) != 0)
+            throw std::runtime_error("matcha: cannot write " + path);
+        if (!written)
+            throw std::runtime_error("matcha: cannot write " + path);
+#if !defined(MATCHA_POSIX)
+        std::remove(path.c_str());
+#endif
+        if (std::rename(temporary.c_str(), path.c_str()) != 0)
+            throw std::runtime_error("matcha: cannot write " + path);
+    }
+
+    std::string directory_;
+    bool update_;
+    bool loaded_;
+    std::map<std::string, entry> index_;
+    std::mutex mutex_;
+};
+
+// in $MATCHA_SNAPSHOT_DIR, or else in ./snapshots; snapshots are rewritten
+// instead of checked when $MATCHA_UPDATE_SNAPSHOTS is set
+MATCHA_INLINE snapshot_store& default_snapshots() {
+    static snapshot_store store(
+        std::getenv("MATCHA_SNAPSHOT_DIR") ? std::getenv("MATCHA_SNAPSHOT_DIR") : "snapshots",
+        std::getenv("MATCHA_UPDATE_SNAPSHOTS") != nullptr);
+    return store;
+}
+
+MATCHA_INLINE bool snapshot_matches(std::string const& id, string_ref bytes) {
+    snapshot_store& store = default_snapshots();
+    snapshot_store::stamp current;
+    if (store.updating() || !store.data_stamp(id, current)) {
+        store.record(id, bytes);
+        return true;
+    }
+    snapshot_store::entry stored;
+    bool const indexed = store.find(id, stored) && stored.file == current;
+    if (indexed) {
+        if (stored.file.size != bytes.size())
+            return false;
+        if (stored.hash == hash_bytes(bytes.data(), bytes.size()))
+            return true;
+    }
+    // the data file changed since it was indexed, or never was, or the
+    // hashes differ: it is read to tell
+    std::unique_ptr<file_contents> recorded;
+    try {
+        recorded.reset(new file_contents(store.data_path(id)));
+    }
+    catch (std::runtime_error const&) {
+        return false;
+    }
+    if (!indexed)
+        store.restore(id, recorded->view());
+    return recorded->view() == bytes;
+}
+
+MATCHA_INLINE std::string snapshot_path(std::string const& id) {
+    return default_snapshots().data_path(id);
+}
+
+// a fixed set of threads running the tasks of one job at a time; the thread
+// calling run() takes tasks too
+class thread_pool {
+public:
+    explicit thread_pool(unsigned threads) : stop_(false), job_(nullptr), generation_(0) {
+        for (unsigned i = 0; i < threads; ++i)
+            workers_.emplace_back([this] { work(); });
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_)
+            worker.join();
+    }
+
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+
+    std::size_t size() const { return workers_.size() + 1; }
+
+    // calls task(i) for every i in [0, tasks), returning once all are done.
+    // Calls made from inside a task run inline, so nested parallel matchers
+    // can't deadlock.
+    void run(std::size_t tasks, std::function<void(std::size_t)> const& task) {
+        if (workers_.empty() || tasks < 2 || in_pool()) {
+            for (std::size_t i = 0; i < tasks; ++i)
+                task(i);
+            return;
+        }
+
+        std::lock_guard<std::mutex> serial(run_mutex_);
+        job j(task, tasks);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &j;
+            ++generation_;
+        }
+        wake_.notify_all();
+
+        in_pool() = true;
+        std::size_t const done = drain(j);
+        in_pool() = false;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        j.done += done;
+        finished_.wait(lock, [&j] { return j.done == j.tasks && j.active == 0; });
+        job_ = nullptr;
+    }
+
+private:
+    struct job {
+        job(std::function<void(std::size_t)> const& t, std::size_t n)
+            : task(t), tasks(n), next(0), done(0), active(0)
+        { }
+
+        std::function<void(std::size_t)> const& task;
+        std::size_t const tasks;
+        std::atomic<std::size_t> next;
+        std::size_t done;     // guarded by mutex_
+        unsigned active;      // guarded by mutex_
+    };
+
+    static bool& in_pool() {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+    static std::size_t drain(job& j) {
+        std::size_t done = 0;
+        for (std::size_t i; (i = j.next++) < j.tasks; ++done)
+            j.task(i);
+        return done;
+    }
+
+    void work() {
+        in_pool() = true;
+        unsigned long seen = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait(lock, [this, &seen] { return stop_ || (job_ && generation_ != seen); });
+            if (stop_)
+                return;
+            seen = generation_;
+            job& j = *job_;
+            ++j.active;
+            lock.unlock();
+            std::size_t const done = drain(j);
+            lock.lock();
+            j.done += done;
+            if (--j.active == 0)
+                finished_.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex run_mutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable finished_;
+    bool stop_;
+    job* job_;
+    unsigned long generation_;
+};
+
+MATCHA_INLINE thread_pool& default_thread_pool() {
+    static thread_pool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+MATCHA_INLINE std::size_t parallel_threads() {
+    return default_thread_pool().size();
+}
+
+MATCHA_INLINE void run_parallel(std::size_t tasks, std::function<void(std::size_t)> const& task) {
+    default_thread_pool().run(tasks, task);
+}
+
+} // namespace detail
+
+namespace detail {
+
+struct compiled_regex {
+    explicit compiled_regex(std::string const& source) : regex(source)
+    { }
+
+    std::regex regex;
+};
+
+} // namespace detail
+
+MATCHA_INLINE regex_pattern::regex_pattern(std::string const& source)
+    : source_(source), regex_(std::make_shared<detail::compiled_regex const>(source))
+{ }
+
+// match results are reused across calls on the same thread, so a successful
+// match doesn't allocate its sub-match storage again
+MATCHA_INLINE bool regex_pattern::match(string_ref text) const {
+    static thread_local std::cmatch results;
+    return std::regex_match(text.data(), text.data() + text.size(), results, regex_->regex);
+}
+
+} // namespace matcha
+
+#endif // _MATCHA_INL_H_
@@ -19,22 +19,129 @@
 #ifndef _MATCHA_H_
 #define _MATCHA_H_
 
+/* MATCHA_LIBRARY builds against libmatcha (src/matcha.cpp), which holds
+ * what doesn't depend on the types under test: regular expressions, the
+ * threads reporting failures and matching in parallel, files and snapshots,
+ * and the failure messages of common equalTo matchers. This header then
+ * only declares them, without <regex>, <thread> or the system headers they
+ * need. libmatcha must be built with the same MATCHA_ macros and target
+ * flags as the tests linked against it.
+ */
+#if defined(MATCHA_LIBRARY)
+#define MATCHA_INLINE
+#else
+#define MATCHA_INLINE inline
+#endif
+
 #include <utility>
+#if defined(MATCHA_LIBRARY)
+#include <ostream>
+#else
 #include <iostream>
 #include <sstream>
+#endif
 #include <algorithm>
 #include <iterator>
 #include <functional>
 #include <set>
+#include <unordered_set>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include <tuple>
 #include <array>
 #include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <limits>
 #include <cctype>
 #include <type_traits>
-#include <regex>
+#include <atomic>
+#if !defined(MATCHA_LIBRARY) || defined(MATCHA_PROFILE)
+#include <thread>
+#include <mutex>
+#endif
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#if __cplusplus >= 201703L
+#include <string_view>
+#include <charconv>
+#endif
 #include "prettyprint.hpp"
+#include "matcha-fwd.hpp"
+
+/* the contents of regular files are mapped into memory where available,
+ * and read otherwise
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#define MATCHA_POSIX
+#endif
+
+/* MATCHA_PROFILE times every assertion against its call site, on the time
+ * stamp counter where there is one, and reports the slowest at exit
+ */
+#if defined(MATCHA_PROFILE)
+#include <chrono>
+#include <typeinfo>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define MATCHA_PROFILE_TSC
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define MATCHA_PROFILE_TSC
+#endif
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+#endif
+
+#if defined(MATCHA_POSIX) && !defined(MATCHA_NO_MMAP)
+#define MATCHA_MMAP
+#endif
+
+/* vectorized kernels are picked at compile time from the target flags,
+ * define MATCHA_NO_SIMD to always use the portable scalar code
+ */
+#if !defined(MATCHA_NO_SIMD)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MATCHA_SIMD_AVX2
+#define MATCHA_SIMD_SSE2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MATCHA_SIMD_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MATCHA_SIMD_NEON
+#endif
+#endif
+
+/* functions made of statements, rather than a single return, can only be
+ * constexpr since C++14
+ */
+#if __cplusplus >= 201402L
+#define MATCHA_CONSTEXPR14 constexpr
+#else
+#define MATCHA_CONSTEXPR14
+#endif
+
+/* evaluates expr once the assertion it belongs to is known by its call
+ * site, so that the next one of the thread is timed against it
+ */
+#if defined(MATCHA_PROFILE)
+#define MATCHA_PROFILE_SITE(expr)                                               \
+    (::matcha::detail::profile_here(                                            \
+        []() -> ::matcha::detail::profile_site const& {                         \
+            static ::matcha::detail::profile_site const site(__FILE__, __LINE__); \
+            return site;                                                        \
+        }()), expr)
+#else
+#define MATCHA_PROFILE_SITE(expr) expr
+#endif
 
 #if defined(MATCHA_GTEST)
 #include "gtest/gtest.h"
@@ -43,7 +150,7 @@
  * the ADD_FAILURE will report the right __FILE__ and __LINE__
  */
 #define assertThat(actual,matcher)  \
-    ASSERT_PRED_FORMAT2(assertResult, actual, matcher)
+    ASSERT_PRED_FORMAT2(assertResult, MATCHA_PROFILE_SITE(actual), matcher)
 
 #elif defined(MATCHA_BOOSTTEST)
 #include <boost/test/included/unit_test.hpp>
@@ -53,15 +160,29 @@
  */
 #define assertThat(actual,matcher)  \
   BOOST_CHECK_MESSAGE               \
-    (assertResult<boost::test_tools::predicate_result>(actual, matcher), "")
+    (MATCHA_PROFILE_SITE(assertResult<boost::test_tools::predicate_result>(actual, matcher)), "")
 
 #else
 
 #define assertThat(actual, matcher) \
-    assertResult<bool>(actual, matcher)
+    MATCHA_PROFILE_SITE(assertResult<bool>(actual, matcher))
 
 #endif
 
+/* checks a constant expression at compile time, the static_assert message
+ * quoting the assertion since the description can't be built then
+ */
+#define static_assertThat(actual, ...)                      \
+    static_assert((__VA_ARGS__).matches(actual),            \
+                  "static_assertThat(" #actual ", " #__VA_ARGS__ ") failed")
+
+/* soft assertions: failures are kept, unformatted, by the innermost
+ * MatchaCollector of the thread and only described when it is flushed
+ */
+#define checkThat(actual, matcher)                          \
+    (::matcha::detail::check_site(__FILE__, __LINE__),      \
+     MATCHA_PROFILE_SITE(::matcha::assertResult< ::matcha::deferred>(actual, matcher)))
+
 namespace matcha {
 
 // SFINAE type trait to detect whether type T satisfies EqualityComparable.
@@ -94,6 +215,37 @@ struct is_lessthan_comparable<T,
     > : std::true_type
 { };
 
+// SFINAE type trait to detect whether std::hash can hash type T.
+
+template<typename T, typename = void>
+struct is_hashable : std::false_type
+{ };
+
+template<typename T>
+struct is_hashable<T,
+    typename std::enable_if<
+        true,
+        decltype((std::declval<std::hash<T> const&>()(std::declval<T const&>())), (void)0)
+        >::type
+    > : std::true_type
+{ };
+
+// SFINAE type trait to detect whether C is an associative container, which
+// can look up its key_type without walking all of its elements.
+
+template<typename C, typename = void>
+struct is_associative : std::false_type
+{ };
+
+template<typename C>
+struct is_associative<C,
+    typename std::enable_if<
+        true,
+        decltype((std::declval<C const&>().find(std::declval<typename C::key_type const&>())), (void)0)
+        >::type
+    > : std::true_type
+{ };
+
 // SFINAE type trait to detect whether a class is a specialization of Template
 
 template <template <typename...> class Template, typename T>
@@ -137,772 +289,6082 @@ operator<<(std::basic_ostream<TChar, TCharTraits> &os, const T &)
     return os;
 }
 
-/*
- * character traits to provide case-insensitive comparison
- * http://www.gotw.ca/gotw/029.htm
- */
-struct ci_char_traits : public std::char_traits<char> {
-    static bool eq(char c1, char c2) {
-         return std::toupper(c1) == std::toupper(c2);
-     }
-    static bool lt(char c1, char c2) {
-         return std::toupper(c1) <  std::toupper(c2);
-    }
-    static int compare(const char* s1, const char* s2, size_t n) {
-        while (n-- != 0) {
-            if (std::toupper(*s1) < std::toupper(*s2))
-                return -1;
-            if (std::toupper(*s1) > std::toupper(*s2))
-                return 1;
-            ++s1; ++s2;
-        }
-        return 0;
-    }
-    static const char* find(const char* s, int n, char a) {
-        auto const ua (std::toupper(a));
-        while (n-- != 0) {
-            if (std::toupper(*s) == ua)
-                return s;
-            s++;
-        }
-        return nullptr;
-    }
-};
+// GCC reports the vector loads of the kernels below as out of bounds when they
+// are inlined with short constant strings, although the loops never run then
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Warray-bounds"
+#endif
 
-// case-insensitive string class
-typedef std::basic_string<char, ci_char_traits> ci_string;
+namespace detail {
 
-std::ostream& operator<<(std::ostream& os, const ci_string& str)
-{
-    return os.write(str.data(), str.size());
+// ASCII case folding; unlike std::toupper it needs no locale lookup
+inline unsigned char ascii_upper(char c) {
+    return (c >= 'a' && c <= 'z') ? static_cast<unsigned char>(c - ('a' - 'A'))
+                                  : static_cast<unsigned char>(c);
 }
 
-template <typename T>
-std::string to_string(T const& val)
-{
-    std::ostringstream out;
-    out << val;
-    return out.str();
+inline std::size_t first_set_bit(unsigned mask) {
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    std::size_t i = 0;
+    while (!(mask & 1u)) { mask >>= 1; ++i; }
+    return i;
+#endif
 }
 
-template<typename T>
-struct output_traits;
-
-template<>
-struct output_traits<bool>
-{
-    typedef bool result_type;
-    static constexpr bool success = true;
-    static constexpr bool failure = false;
-
-    static std::ostream & ostream(bool & result) {
-        return std::cout;
-    }
-};
+#if defined(MATCHA_SIMD_SSE2)
+inline __m128i ascii_upper(__m128i x) {
+    // bytes >= 0x80 are negative as signed and never in the a-z range
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(x, _mm_set1_epi8('z' + 1)));
+    return _mm_sub_epi8(x, _mm_and_si128(lower, _mm_set1_epi8('a' - 'A')));
+}
+#endif
 
-#if defined(MATCHA_GTEST)
+#if defined(MATCHA_SIMD_AVX2)
+inline __m256i ascii_upper(__m256i x) {
+    __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8('a' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), x));
+    return _mm256_sub_epi8(x, _mm256_and_si256(lower, _mm256_set1_epi8('a' - 'A')));
+}
+#endif
 
-template<>
-struct output_traits<::testing::AssertionResult>
-{
-    typedef ::testing::AssertionResult result_type;
+#if defined(MATCHA_SIMD_NEON)
+inline uint8x16_t ascii_upper(uint8x16_t x) {
+    uint8x16_t lower = vandq_u8(vcgeq_u8(x, vdupq_n_u8('a')), vcleq_u8(x, vdupq_n_u8('z')));
+    return vsubq_u8(x, vandq_u8(lower, vdupq_n_u8('a' - 'A')));
+}
+#endif
 
-    static ::testing::AssertionResult success() {
-        return ::testing::AssertionSuccess();
+// position of the first of n characters that differ in s1 and s2 ignoring
+// (ASCII) case, or n if there is none
+inline std::size_t ci_mismatch(char const* s1, char const* s2, std::size_t n) {
+    std::size_t i = 0;
+#if defined(MATCHA_SIMD_AVX2)
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(s1 + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(s2 + i));
+        unsigned eq = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(ascii_upper(a), ascii_upper(b))));
+        if (eq != 0xffffffffu)
+            return i + first_set_bit(~eq);
     }
-
-    static ::testing::AssertionResult failure() {
-        return ::testing::AssertionFailure();
+#endif
+#if defined(MATCHA_SIMD_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s1 + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s2 + i));
+        unsigned eq = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(ascii_upper(a), ascii_upper(b))));
+        if (eq != 0xffffu)
+            return i + first_set_bit(~eq & 0xffffu);
     }
-
-    static ::testing::AssertionResult & 
-    ostream(::testing::AssertionResult &result) {
-        return result;
+#elif defined(MATCHA_SIMD_NEON)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t a = vld1q_u8(reinterpret_cast<uint8_t const*>(s1 + i));
+        uint8x16_t b = vld1q_u8(reinterpret_cast<uint8_t const*>(s2 + i));
+        if (vminvq_u8(vceqq_u8(ascii_upper(a), ascii_upper(b))) != 0xff)
+            break; // the scalar loop below finds the position
     }
-};
-
-template<class T, class Matcher>
-::testing::AssertionResult
-assertResult(const char *, const char *, T const& actual, Matcher const& matcher) {
-    return assertResult<::testing::AssertionResult>(actual, matcher);
+#endif
+    for (; i < n; ++i) {
+        if (ascii_upper(s1[i]) != ascii_upper(s2[i]))
+            return i;
+    }
+    return n;
 }
 
-#elif defined(MATCHA_BOOSTTEST)
+// white space as std::isspace reports it in the default "C" locale
+inline bool ascii_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
 
-template<>
-struct output_traits<boost::test_tools::predicate_result>
-{
-    typedef boost::test_tools::predicate_result result_type;
+#if defined(MATCHA_SIMD_SSE2)
+inline unsigned ascii_space_mask(__m128i x) {
+    __m128i ctrl = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('\t' - 1)),
+                                 _mm_cmplt_epi8(x, _mm_set1_epi8('\r' + 1)));
+    return static_cast<unsigned>(_mm_movemask_epi8(
+        _mm_or_si128(ctrl, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')))));
+}
+#endif
 
-    static bool success() { 
-        return true; 
+// position of the first non white space character of s at or after i
+inline std::size_t skip_space(char const* s, std::size_t i, std::size_t n) {
+#if defined(MATCHA_SIMD_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        unsigned space = ascii_space_mask(_mm_loadu_si128(reinterpret_cast<__m128i const*>(s + i)));
+        if (space != 0xffffu)
+            return i + first_set_bit(~space & 0xffffu);
     }
+#endif
+    while (i < n && ascii_space(s[i]))
+        ++i;
+    return i;
+}
 
-    static boost::test_tools::predicate_result failure() { 
-        return false; 
+// walks both strings at once, skipping white space runs in each, and stops
+// at the first character that differs
+inline bool equal_ignoring_space(char const* s1, std::size_t n1, char const* s2, std::size_t n2) {
+    std::size_t i = 0, j = 0;
+    for (;;) {
+        i = skip_space(s1, i, n1);
+        j = skip_space(s2, j, n2);
+#if defined(MATCHA_SIMD_SSE2)
+        // runs of equal, non white space characters are consumed 16 at a time
+        while (i + 16 <= n1 && j + 16 <= n2) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s1 + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s2 + j));
+            unsigned same = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)))
+                          & ~ascii_space_mask(a) & 0xffffu;
+            if (same != 0xffffu) {
+                std::size_t k = first_set_bit(~same & 0xffffu);
+                i += k;
+                j += k;
+                break;
+            }
+            i += 16;
+            j += 16;
+        }
+        if ((i < n1 && ascii_space(s1[i])) || (j < n2 && ascii_space(s2[j])))
+            continue;
+#endif
+        if (i == n1 || j == n2)
+            return skip_space(s1, i, n1) == n1 && skip_space(s2, j, n2) == n2;
+        if (s1[i] != s2[j])
+            return false;
+        ++i;
+        ++j;
     }
+}
 
-    static decltype(std::declval<boost::test_tools::predicate_result>().message()) & 
-    ostream(boost::test_tools::predicate_result & result) {
-        return result.message();
-    }
-};
+} // namespace detail
 
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
 #endif
 
-template<class Result, class T, class Matcher>
-typename output_traits<Result>::result_type
-assertResult(T const& actual, Matcher const& matcher) {
-    Result result = output_traits<Result>::failure();
+// one bit per element of a batch, as filled in by Matcher::matches_batch
+typedef std::uint64_t match_word;
 
-    if (matcher.matches(actual))
-        return output_traits<Result>::success();
+namespace detail {
 
-    output_traits<Result>::ostream(result)    << '\n'
-        << "Expected: " << to_string(matcher) << '\n'
-        << "but got : " << to_string(actual)  << '\n'; 
+static const std::size_t match_word_bits = 64;
 
-    return result;
+inline std::size_t popcount(match_word w) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(w);
+#else
+    std::size_t c = 0;
+    for (; w; w &= w - 1)
+        ++c;
+    return c;
+#endif
 }
 
-template<class MatcherPolicy, class ExpectedType = void>
-class Matcher : public MatcherPolicy {
-public:
-    Matcher(ExpectedType const& value = ExpectedType()) : expected_(value)
-    { }
+inline std::size_t first_set_bit(match_word w) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(w);
+#else
+    std::size_t i = 0;
+    while (!(w & 1u)) { w >>= 1; ++i; }
+    return i;
+#endif
+}
 
-    template<class ActualType>
-    bool matches(ActualType const& actual) const {
-        return MatcherPolicy::matches(expected_, actual);
-    }
+// floating-point values as integers in the same order, both zeroes at 0
+inline std::int64_t ordered_bits(double x) {
+    std::int64_t i;
+    std::memcpy(&i, &x, sizeof i);
+    return i < 0 ? INT64_MIN - i : i;
+}
 
-    template<size_t M>
-    bool matches(char const (&actual)[M]) const {
-        return MatcherPolicy::matches(expected_, std::string(actual));
-    }
+inline std::int64_t ordered_bits(float x) {
+    std::int32_t i;
+    std::memcpy(&i, &x, sizeof i);
+    return i < 0 ? INT32_MIN - i : i;
+}
 
-    friend std::ostream& operator<<(std::ostream& o, Matcher const& matcher) {
-        matcher.describe(o, matcher.expected_);
-        return o;
+// how many representable values lie between e and a, NaNs aside
+template<typename T>
+std::uint64_t ulp_distance(T e, T a) {
+    std::int64_t const oe = ordered_bits(e);
+    std::int64_t const oa = ordered_bits(a);
+    return oa > oe ? std::uint64_t(oa) - std::uint64_t(oe) : std::uint64_t(oe) - std::uint64_t(oa);
+}
+
+// vector registers for batches of T, where the target has them
+template<typename T>
+struct simd_lanes {
+    static const bool enabled = false;
+};
+
+#if defined(MATCHA_SIMD_AVX2)
+template<>
+struct simd_lanes<float> {
+    static const bool enabled = true;
+    static const std::size_t width = 8;
+    static const bool native_ulps = true;
+    typedef __m256 reg;
+    static reg load(float const* p) { return _mm256_loadu_ps(p); }
+    static reg set1(float v) { return _mm256_set1_ps(v); }
+    static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    static reg abs(reg a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static unsigned mask(reg a) { return static_cast<unsigned>(_mm256_movemask_ps(a)); }
+    static reg cmp(std::less<float>, reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static reg cmp(std::less_equal<float>, reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static reg cmp(std::greater<float>, reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static reg cmp(std::greater_equal<float>, reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static reg cmp(std::equal_to<float>, reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+    static reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+    static reg both(reg a, reg b) { return _mm256_and_ps(a, b); }
+    static reg either(reg a, reg b) { return _mm256_or_ps(a, b); }
+    static reg nan(reg a) { return _mm256_cmp_ps(a, a, _CMP_UNORD_Q); }
+    // ulp distance, of values ordered as integers with both zeroes at 0
+    static reg ulps_within(reg e, reg a, std::uint64_t n) {
+        __m256i const zero = _mm256_setzero_si256();
+        __m256i const lowest = _mm256_set1_epi32(INT32_MIN);
+        __m256i const limit = _mm256_set1_epi32(int(std::min<std::uint64_t>(n, INT32_MAX)));
+        __m256i ie = _mm256_castps_si256(e);
+        __m256i ia = _mm256_castps_si256(a);
+        ie = _mm256_blendv_epi8(ie, _mm256_sub_epi32(lowest, ie), _mm256_cmpgt_epi32(zero, ie));
+        ia = _mm256_blendv_epi8(ia, _mm256_sub_epi32(lowest, ia), _mm256_cmpgt_epi32(zero, ia));
+        __m256i far = _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_sub_epi32(ia, ie), limit),
+                                      _mm256_cmpgt_epi32(_mm256_sub_epi32(ie, ia), limit));
+        // of opposite signs, the distance is the sum of the magnitudes, which
+        // the differences wrap past: it is within n only if each one is
+        __m256i const least = _mm256_sub_epi32(zero, limit);
+        __m256i const apart = _mm256_cmpgt_epi32(zero, _mm256_xor_si256(ie, ia));
+        __m256i const beyond = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi32(ie, limit), _mm256_cmpgt_epi32(ia, limit)),
+            _mm256_or_si256(_mm256_cmpgt_epi32(least, ie), _mm256_cmpgt_epi32(least, ia)));
+        far = _mm256_or_si256(far, _mm256_and_si256(apart, beyond));
+        return _mm256_castsi256_ps(_mm256_andnot_si256(far, _mm256_set1_epi32(-1)));
     }
-private:
-    ExpectedType expected_;
 };
 
-// there is no expected value, for matcher not taking input parameters
-template<class MatcherPolicy>
-class Matcher<MatcherPolicy,void> : public MatcherPolicy {
-public:
-    template<class ActualType>
-    bool matches(ActualType const& actual) const {
-        return MatcherPolicy::matches(actual);
+template<>
+struct simd_lanes<double> {
+    static const bool enabled = true;
+    static const std::size_t width = 4;
+    static const bool native_ulps = true;
+    typedef __m256d reg;
+    static reg load(double const* p) { return _mm256_loadu_pd(p); }
+    static reg set1(double v) { return _mm256_set1_pd(v); }
+    static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+    static reg abs(reg a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static unsigned mask(reg a) { return static_cast<unsigned>(_mm256_movemask_pd(a)); }
+    static reg cmp(std::less<double>, reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static reg cmp(std::less_equal<double>, reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+    static reg cmp(std::greater<double>, reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static reg cmp(std::greater_equal<double>, reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+    static reg cmp(std::equal_to<double>, reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+    static reg max(reg a, reg b) { return _mm256_max_pd(a, b); }
+    static reg both(reg a, reg b) { return _mm256_and_pd(a, b); }
+    static reg either(reg a, reg b) { return _mm256_or_pd(a, b); }
+    static reg nan(reg a) { return _mm256_cmp_pd(a, a, _CMP_UNORD_Q); }
+    static reg ulps_within(reg e, reg a, std::uint64_t n) {
+        __m256i const zero = _mm256_setzero_si256();
+        __m256i const lowest = _mm256_set1_epi64x(INT64_MIN);
+        __m256i const limit = _mm256_set1_epi64x(std::int64_t(std::min<std::uint64_t>(n, INT64_MAX)));
+        __m256i ie = _mm256_castpd_si256(e);
+        __m256i ia = _mm256_castpd_si256(a);
+        ie = _mm256_blendv_epi8(ie, _mm256_sub_epi64(lowest, ie), _mm256_cmpgt_epi64(zero, ie));
+        ia = _mm256_blendv_epi8(ia, _mm256_sub_epi64(lowest, ia), _mm256_cmpgt_epi64(zero, ia));
+        __m256i far = _mm256_or_si256(_mm256_cmpgt_epi64(_mm256_sub_epi64(ia, ie), limit),
+                                      _mm256_cmpgt_epi64(_mm256_sub_epi64(ie, ia), limit));
+        __m256i const least = _mm256_sub_epi64(zero, limit);
+        __m256i const apart = _mm256_cmpgt_epi64(zero, _mm256_xor_si256(ie, ia));
+        __m256i const beyond = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi64(ie, limit), _mm256_cmpgt_epi64(ia, limit)),
+            _mm256_or_si256(_mm256_cmpgt_epi64(least, ie), _mm256_cmpgt_epi64(least, ia)));
+        far = _mm256_or_si256(far, _mm256_and_si256(apart, beyond));
+        return _mm256_castsi256_pd(_mm256_andnot_si256(far, _mm256_set1_epi64x(-1)));
+    }
+};
+#elif defined(MATCHA_SIMD_SSE2)
+template<>
+struct simd_lanes<float> {
+    static const bool enabled = true;
+    static const std::size_t width = 4;
+    static const bool native_ulps = true;
+    typedef __m128 reg;
+    static reg load(float const* p) { return _mm_loadu_ps(p); }
+    static reg set1(float v) { return _mm_set1_ps(v); }
+    static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+    static reg abs(reg a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static unsigned mask(reg a) { return static_cast<unsigned>(_mm_movemask_ps(a)); }
+    static reg cmp(std::less<float>, reg a, reg b) { return _mm_cmplt_ps(a, b); }
+    static reg cmp(std::less_equal<float>, reg a, reg b) { return _mm_cmple_ps(a, b); }
+    static reg cmp(std::greater<float>, reg a, reg b) { return _mm_cmpgt_ps(a, b); }
+    static reg cmp(std::greater_equal<float>, reg a, reg b) { return _mm_cmpge_ps(a, b); }
+    static reg cmp(std::equal_to<float>, reg a, reg b) { return _mm_cmpeq_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+    static reg max(reg a, reg b) { return _mm_max_ps(a, b); }
+    static reg both(reg a, reg b) { return _mm_and_ps(a, b); }
+    static reg either(reg a, reg b) { return _mm_or_ps(a, b); }
+    static reg nan(reg a) { return _mm_cmpunord_ps(a, a); }
+    static reg ulps_within(reg e, reg a, std::uint64_t n) {
+        __m128i const zero = _mm_setzero_si128();
+        __m128i const lowest = _mm_set1_epi32(INT32_MIN);
+        __m128i const limit = _mm_set1_epi32(int(std::min<std::uint64_t>(n, INT32_MAX)));
+        __m128i ie = _mm_castps_si128(e);
+        __m128i ia = _mm_castps_si128(a);
+        __m128i const ne = _mm_cmpgt_epi32(zero, ie);
+        __m128i const na = _mm_cmpgt_epi32(zero, ia);
+        ie = _mm_or_si128(_mm_and_si128(ne, _mm_sub_epi32(lowest, ie)), _mm_andnot_si128(ne, ie));
+        ia = _mm_or_si128(_mm_and_si128(na, _mm_sub_epi32(lowest, ia)), _mm_andnot_si128(na, ia));
+        __m128i far = _mm_or_si128(_mm_cmpgt_epi32(_mm_sub_epi32(ia, ie), limit),
+                                   _mm_cmpgt_epi32(_mm_sub_epi32(ie, ia), limit));
+        __m128i const least = _mm_sub_epi32(zero, limit);
+        __m128i const apart = _mm_cmpgt_epi32(zero, _mm_xor_si128(ie, ia));
+        __m128i const beyond = _mm_or_si128(
+            _mm_or_si128(_mm_cmpgt_epi32(ie, limit), _mm_cmpgt_epi32(ia, limit)),
+            _mm_or_si128(_mm_cmpgt_epi32(least, ie), _mm_cmpgt_epi32(least, ia)));
+        far = _mm_or_si128(far, _mm_and_si128(apart, beyond));
+        return _mm_castsi128_ps(_mm_andnot_si128(far, _mm_set1_epi32(-1)));
     }
+};
 
-    friend std::ostream& operator<<(std::ostream& o, Matcher const& matcher) {
-        matcher.describe(o);
-        return o;
+template<>
+struct simd_lanes<double> {
+    static const bool enabled = true;
+    static const std::size_t width = 2;
+    static const bool native_ulps = false;
+    typedef __m128d reg;
+    static reg load(double const* p) { return _mm_loadu_pd(p); }
+    static reg set1(double v) { return _mm_set1_pd(v); }
+    static reg sub(reg a, reg b) { return _mm_sub_pd(a, b); }
+    static reg abs(reg a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+    static unsigned mask(reg a) { return static_cast<unsigned>(_mm_movemask_pd(a)); }
+    static reg cmp(std::less<double>, reg a, reg b) { return _mm_cmplt_pd(a, b); }
+    static reg cmp(std::less_equal<double>, reg a, reg b) { return _mm_cmple_pd(a, b); }
+    static reg cmp(std::greater<double>, reg a, reg b) { return _mm_cmpgt_pd(a, b); }
+    static reg cmp(std::greater_equal<double>, reg a, reg b) { return _mm_cmpge_pd(a, b); }
+    static reg cmp(std::equal_to<double>, reg a, reg b) { return _mm_cmpeq_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+    static reg max(reg a, reg b) { return _mm_max_pd(a, b); }
+    static reg both(reg a, reg b) { return _mm_and_pd(a, b); }
+    static reg either(reg a, reg b) { return _mm_or_pd(a, b); }
+    static reg nan(reg a) { return _mm_cmpunord_pd(a, a); }
+    // SSE2 compares no 64-bit integers, so each lane is done on its own,
+    // slower than the scalar loop, which native_ulps leaves ulp_pair_pred to
+    static reg ulps_within(reg e, reg a, std::uint64_t n) {
+        double es[2], as[2];
+        _mm_storeu_pd(es, e);
+        _mm_storeu_pd(as, a);
+        return _mm_castsi128_pd(_mm_set_epi64x(ulp_distance(es[1], as[1]) <= n ? -1 : 0,
+                                               ulp_distance(es[0], as[0]) <= n ? -1 : 0));
     }
 };
+#endif
 
-// C-style arrays and strings
-template<class MatcherPolicy, class ExpectedType, size_t N>
-class Matcher<MatcherPolicy,ExpectedType[N]> : public MatcherPolicy
-{
-public:
-    Matcher(ExpectedType const (&value)[N]) : expected_(value)
-    { }
+// element predicates of the batch kernels, with a scalar and a vector form
 
-    template<size_t M>
-    bool matches(ExpectedType const (&actual)[M]) const {
-        std::vector<ExpectedType> actual_vec(actual, actual + M), expected_vec(expected_, expected_ + N);
-        return MatcherPolicy::matches(expected_vec, actual_vec);
-    }
- 
-    bool matches(std::string const& actual) const {
-        return MatcherPolicy::matches(std::string(expected_), actual);
-    }
+// F()(x, value), F being one of the std comparison function objects
+template<typename T, typename F>
+struct compare_pred {
+    T value;
 
-    friend std::ostream& operator<<(std::ostream& o, Matcher const& matcher) {
-        matcher.describe(o, matcher.expected_);
-        return o;
+    bool operator()(T x) const { return F()(x, value); }
+
+    template<typename Lanes>
+    typename Lanes::reg simd(typename Lanes::reg x) const {
+        return Lanes::cmp(F(), x, Lanes::set1(value));
     }
-private:
-    ExpectedType const (&expected_)[N];
 };
 
-// this is just sugar to make it easy to create a matcher
-// still preferred to use a free function though
+// |x - value| <= delta
+template<typename T>
+struct close_pred {
+    T value;
+    T delta;
 
-template<class MatcherPolicy>
-struct MatcherGenerator {
+    bool operator()(T x) const { return std::fabs(x - value) <= delta; }
 
-    template<typename... T>
-    Matcher<MatcherPolicy,T...> operator()(T const& ...value) const {
-        return Matcher<MatcherPolicy,T...>(value...); 
+    template<typename Lanes>
+    typename Lanes::reg simd(typename Lanes::reg x) const {
+        return Lanes::cmp(std::less_equal<T>(), Lanes::abs(Lanes::sub(x, Lanes::set1(value))),
+                          Lanes::set1(delta));
     }
+};
 
-    template<typename T, size_t N>
-    Matcher<MatcherPolicy,T[N]> operator()(T const (&value)[N]) const {
-        return Matcher<MatcherPolicy,T[N]>(value);
+// sets bit i of bits to pred(data[i]) for the n elements of data
+template<typename T, typename Pred>
+void batch_apply(T const* data, std::size_t n, Pred const& pred, match_word* bits, std::false_type) {
+    for (std::size_t i = 0; i < n; i += match_word_bits) {
+        std::size_t const len = std::min(match_word_bits, n - i);
+        match_word word = 0;
+        for (std::size_t b = 0; b < len; ++b)
+            word |= match_word(pred(data[i + b])) << b;
+        bits[i / match_word_bits] = word;
     }
-};
+}
 
-template<class MatcherPolicy>
-MatcherGenerator<MatcherPolicy> make_matcher() {
-    return MatcherGenerator<MatcherPolicy>();
+template<typename T, typename Pred>
+void batch_apply(T const* data, std::size_t n, Pred const& pred, match_word* bits, std::true_type) {
+    typedef simd_lanes<T> lanes;
+    std::size_t i = 0;
+    for (; i + match_word_bits <= n; i += match_word_bits) {
+        match_word word = 0;
+        for (std::size_t k = 0; k < match_word_bits; k += lanes::width)
+            word |= match_word(lanes::mask(pred.template simd<lanes>(lanes::load(data + i + k)))) << k;
+        bits[i / match_word_bits] = word;
+    }
+    batch_apply(data + i, n - i, pred, bits + i / match_word_bits, std::false_type());
 }
 
+template<typename T, typename Pred>
+void batch_apply(T const* data, std::size_t n, Pred const& pred, match_word* bits) {
+    batch_apply(data, n, pred, bits, std::integral_constant<bool, simd_lanes<T>::enabled>());
+}
 
+} // namespace detail
 
+// whether a NaN never matches, or matches a NaN
+enum class nan_policy { mismatch, equal };
 
-// SFINAE type trait to detect whether one or more classes are matchers
+namespace detail {
 
-template<typename... Ts>
-struct is_matcher : std::false_type 
-{ };
+// predicates of pairs of elements, expected e and actual a, with a scalar
+// and a vector form, and the error reported for a pair that fails
 
+// |a - e| <= max(absolute, relative * max(|a|, |e|)), infinities matching
+// only themselves
 template<typename T>
-struct is_matcher<T> : is_specialization_of<Matcher,T> 
-{ };
+struct close_pair_pred {
+    T absolute;
+    T relative;
+    nan_policy nan;
+
+    bool operator()(T e, T a) const {
+        if (a == e)
+            return true;
+        if (std::isnan(a) || std::isnan(e))
+            return nan == nan_policy::equal && std::isnan(a) && std::isnan(e);
+        T const diff = std::fabs(a - e);
+        return diff <= std::max(absolute, relative * std::max(std::fabs(a), std::fabs(e)))
+            && diff < std::numeric_limits<T>::infinity();
+    }
 
-template<typename First, typename... Rest>
-struct is_matcher<First, Rest...>
-    : std::integral_constant<
-        bool,
-        is_matcher<First>::value && is_matcher<Rest...>::value
-      >
-{ };
+    bool vectorized() const {
+        return true;
+    }
 
-struct Is {
-protected:
-    template<typename MatcherType, typename ActualType>
-    bool matches(MatcherType const& expected, ActualType const& actual) const {
-        static_assert(is_matcher<MatcherType>::value, "IsNot matcher requires a Matcher parameter");
-        return expected.matches(actual);
+    template<typename Lanes>
+    typename Lanes::reg simd(typename Lanes::reg e, typename Lanes::reg a) const {
+        typename Lanes::reg const diff = Lanes::abs(Lanes::sub(a, e));
+        typename Lanes::reg const bound = Lanes::max(Lanes::set1(absolute),
+            Lanes::mul(Lanes::set1(relative), Lanes::max(Lanes::abs(a), Lanes::abs(e))));
+        typename Lanes::reg ok = Lanes::either(Lanes::cmp(std::equal_to<T>(), a, e),
+            Lanes::both(Lanes::cmp(std::less_equal<T>(), diff, bound),
+                        Lanes::cmp(std::less<T>(), diff, Lanes::set1(std::numeric_limits<T>::infinity()))));
+        if (nan == nan_policy::equal)
+            ok = Lanes::either(ok, Lanes::both(Lanes::nan(a), Lanes::nan(e)));
+        return ok;
     }
 
-    template<typename MatcherType>
-    void describe(std::ostream& o, MatcherType const& expected) const {
-        o << "is " << expected;
+    double error(T e, T a) const {
+        return std::isnan(a) || std::isnan(e) ? std::numeric_limits<double>::infinity()
+                                              : std::fabs(double(a) - double(e));
     }
 };
 
-auto is = make_matcher<Is>();
-
+// at most ulps representable values between a and e
+template<typename T>
+struct ulp_pair_pred {
+    std::uint64_t ulps;
+    nan_policy nan;
+
+    bool operator()(T e, T a) const {
+        if (std::isnan(a) || std::isnan(e))
+            return nan == nan_policy::equal && std::isnan(a) && std::isnan(e);
+        return ulp_distance(e, a) <= ulps;
+    }
+
+    // the vector form bounds the magnitudes of values of opposite signs by
+    // ulps, which keeps their sum, past 2^(bits-2) ulps, from wrapping
+    bool vectorized() const {
+        return simd_lanes<T>::native_ulps && ulps < (std::uint64_t(1) << (sizeof(T) * 8 - 2));
+    }
+
+    template<typename Lanes>
+    typename Lanes::reg simd(typename Lanes::reg e, typename Lanes::reg a) const {
+        // NaNs compare as integers like any other bits, so they are masked out
+        typename Lanes::reg ok = Lanes::both(Lanes::ulps_within(e, a, ulps),
+            Lanes::both(Lanes::cmp(std::equal_to<T>(), a, a), Lanes::cmp(std::equal_to<T>(), e, e)));
+        if (nan == nan_policy::equal)
+            ok = Lanes::either(ok, Lanes::both(Lanes::nan(a), Lanes::nan(e)));
+        return ok;
+    }
+
+    double error(T e, T a) const {
+        return std::isnan(a) || std::isnan(e) ? std::numeric_limits<double>::infinity()
+                                              : double(ulp_distance(e, a));
+    }
+};
+
+// index of the first pair of the n elements of e and a failing pred, or n
+template<typename T, typename Pred>
+std::size_t first_mismatch(T const* e, T const* a, std::size_t n, Pred const& pred, std::false_type) {
+    std::size_t i = 0;
+    while (i < n && pred(e[i], a[i]))
+        ++i;
+    return i;
+}
+
+// four vectors at a time, the block with a failing pair searched again one
+// pair at a time
+template<typename T, typename Pred>
+std::size_t first_mismatch(T const* e, T const* a, std::size_t n, Pred const& pred, std::true_type) {
+    typedef simd_lanes<T> lanes;
+    if (!pred.vectorized())
+        return first_mismatch(e, a, n, pred, std::false_type());
+    static const std::size_t step = 4 * lanes::width;
+    static const unsigned all = (1u << lanes::width) - 1;
+    std::size_t i = 0;
+    for (; i + step <= n; i += step) {
+        typename lanes::reg const ok = lanes::both(
+            lanes::both(pred.template simd<lanes>(lanes::load(e + i), lanes::load(a + i)),
+                        pred.template simd<lanes>(lanes::load(e + i + lanes::width), lanes::load(a + i + lanes::width))),
+            lanes::both(pred.template simd<lanes>(lanes::load(e + i + 2 * lanes::width), lanes::load(a + i + 2 * lanes::width)),
+                        pred.template simd<lanes>(lanes::load(e + i + 3 * lanes::width), lanes::load(a + i + 3 * lanes::width))));
+        if (lanes::mask(ok) != all)
+            break;
+    }
+    return i + first_mismatch(e + i, a + i, n - i, pred, std::false_type());
+}
+
+template<typename T, typename Pred>
+std::size_t first_mismatch(T const* e, T const* a, std::size_t n, Pred const& pred) {
+    return first_mismatch(e, a, n, pred, std::integral_constant<bool, simd_lanes<T>::enabled>());
+}
+
+} // namespace detail
+
+/*
+ * character traits to provide case-insensitive comparison
+ * http://www.gotw.ca/gotw/029.htm
+ *
+ * case is folded for ASCII letters only, as std::toupper does in the
+ * default "C" locale
+ */
+struct ci_char_traits : public std::char_traits<char> {
+    static bool eq(char c1, char c2) {
+         return detail::ascii_upper(c1) == detail::ascii_upper(c2);
+     }
+    static bool lt(char c1, char c2) {
+         return detail::ascii_upper(c1) <  detail::ascii_upper(c2);
+    }
+    static int compare(const char* s1, const char* s2, size_t n) {
+        size_t i = detail::ci_mismatch(s1, s2, n);
+        if (i == n)
+            return 0;
+        return detail::ascii_upper(s1[i]) < detail::ascii_upper(s2[i]) ? -1 : 1;
+    }
+    static const char* find(const char* s, int n, char a) {
+        auto const ua (detail::ascii_upper(a));
+        while (n-- != 0) {
+            if (detail::ascii_upper(*s) == ua)
+                return s;
+            s++;
+        }
+        return nullptr;
+    }
+};
+
+// case-insensitive string class
+typedef std::basic_string<char, ci_char_traits> ci_string;
+
+inline std::ostream& operator<<(std::ostream& os, const ci_string& str)
+{
+    return os.write(str.data(), str.size());
+}
+
+/*
+ * non-owning view of a character sequence, so that string matchers can work
+ * on std::string, C strings and (pointer, length) slices of larger buffers
+ * without copying them into a std::string first
+ */
+class string_ref {
+public:
+    typedef char value_type;
+    typedef char const* iterator;
+    typedef std::size_t size_type;
+
+    static constexpr size_type npos = size_type(-1);
+
+    constexpr string_ref() : data_(nullptr), size_(0)
+    { }
+
+    constexpr string_ref(char const* s, size_type n) : data_(s), size_(n)
+    { }
+
+    string_ref(char const* s) : data_(s), size_(std::strlen(s))
+    { }
+
+    string_ref(std::string const& s) : data_(s.data()), size_(s.size())
+    { }
+
+#if __cplusplus >= 201703L
+    constexpr string_ref(std::string_view s) : data_(s.data()), size_(s.size())
+    { }
+#endif
+
+    constexpr char const* data() const { return data_; }
+    constexpr size_type size() const { return size_; }
+    constexpr bool empty() const { return size_ == 0; }
+
+    constexpr iterator begin() const { return data_; }
+    constexpr iterator end() const { return data_ + size_; }
+
+    constexpr char operator[](size_type i) const { return data_[i]; }
+
+    string_ref substr(size_type pos, size_type n = npos) const {
+        pos = std::min(pos, size_);
+        return string_ref(data_ + pos, std::min(n, size_ - pos));
+    }
+
+    bool starts_with(string_ref prefix) const {
+        return size_ >= prefix.size_ && !compare_n(data_, prefix.data_, prefix.size_);
+    }
+
+    bool ends_with(string_ref suffix) const {
+        return size_ >= suffix.size_ && !compare_n(data_ + size_ - suffix.size_, suffix.data_, suffix.size_);
+    }
+
+    size_type find(string_ref needle) const {
+        auto it = std::search(begin(), end(), needle.begin(), needle.end());
+        return it == end() && !needle.empty() ? npos : size_type(it - begin());
+    }
+
+    std::string str() const { return std::string(data_, size_); }
+    explicit operator std::string() const { return str(); }
+
+    friend bool operator==(string_ref lhs, string_ref rhs) {
+        return lhs.size_ == rhs.size_ && !compare_n(lhs.data_, rhs.data_, lhs.size_);
+    }
+
+    friend bool operator!=(string_ref lhs, string_ref rhs) {
+        return !(lhs == rhs);
+    }
+
+    friend bool operator<(string_ref lhs, string_ref rhs) {
+        int c = compare_n(lhs.data_, rhs.data_, std::min(lhs.size_, rhs.size_));
+        return c < 0 || (c == 0 && lhs.size_ < rhs.size_);
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, string_ref str) {
+        return os.write(str.data_, str.size_);
+    }
+
+private:
+    // memcmp is undefined for null pointers, even with zero length
+    static int compare_n(char const* s1, char const* s2, size_type n) {
+        return n ? std::memcmp(s1, s2, n) : 0;
+    }
+
+    char const* data_;
+    size_type size_;
+};
+
+/*
+ * non-owning view of a contiguous sequence of T: C arrays, std::array,
+ * std::vector and (pointer, length) buffers all compare through it without
+ * being copied
+ */
+template<typename T>
+class array_ref {
+public:
+    typedef T value_type;
+    typedef T const* const_iterator;
+    typedef std::size_t size_type;
+
+    constexpr array_ref() : data_(nullptr), size_(0)
+    { }
+
+    constexpr array_ref(T const* p, size_type n) : data_(p), size_(n)
+    { }
+
+    template<size_t N>
+    constexpr array_ref(T const (&a)[N]) : data_(a), size_(N)
+    { }
+
+    template<typename C, typename = typename std::enable_if<
+        std::is_convertible<decltype(std::declval<C const&>().data()), T const*>::value
+        >::type>
+    array_ref(C const& cont) : data_(cont.data()), size_(cont.size())
+    { }
+
+    constexpr T const* data() const { return data_; }
+    constexpr size_type size() const { return size_; }
+    constexpr bool empty() const { return size_ == 0; }
+
+    constexpr const_iterator begin() const { return data_; }
+    constexpr const_iterator end() const { return data_ + size_; }
+
+    constexpr T const& operator[](size_type i) const { return data_[i]; }
+
+    // std::equal turns into memcmp for trivially comparable element types
+    friend bool operator==(array_ref lhs, array_ref rhs) {
+        return lhs.size_ == rhs.size_ && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+    }
+
+    friend bool operator!=(array_ref lhs, array_ref rhs) {
+        return !(lhs == rhs);
+    }
+
+private:
+    T const* data_;
+    size_type size_;
+};
+
+namespace detail {
+
+// element type of a container or C array; no type for anything else, so
+// overloads taking either a range or a single value can tell them apart
+template<typename C, typename = void>
+struct range_value
+{ };
+
+template<typename C>
+struct range_value<C, decltype(void(std::begin(std::declval<C const&>())))> {
+    typedef typename std::decay<decltype(*std::begin(std::declval<C const&>()))>::type type;
+};
+
+// SFINAE type trait to detect whether a container keeps its items in an
+// order that equality depends on: not strings, nor hashed containers
+
+template<typename C, typename = void>
+struct is_hashed : std::false_type
+{ };
+
+template<typename C>
+struct is_hashed<C,
+    typename std::enable_if<true, decltype((void)std::declval<typename C::hasher*>())>::type
+    > : std::true_type
+{ };
+
+template<typename C>
+struct is_sequence : std::integral_constant<bool,
+    ::pretty_print::is_container<C>::value
+    && !std::is_convertible<C const&, string_ref>::value
+    && !is_hashed<C>::value>
+{ };
+
+// length of a string held in a char array, which needn't be filled up
+template<std::size_t N>
+string_ref array_string(char const (&s)[N]) {
+    return string_ref(s, std::find(s, s + N, '\0') - s);
+}
+
+// SFINAE type trait to detect whether a matcher policy can be called with
+// arguments of the given types. Policies' matches() are usually protected,
+// so the check is made from a class derived from the policy.
+template<typename Policy>
+struct policy_probe : Policy {
+    template<typename... Args>
+    static auto test(int)
+        -> decltype(std::declval<policy_probe const&>().matches(std::declval<Args>()...), std::true_type());
+
+    template<typename... Args>
+    static std::false_type test(...);
+
+    // matches_batch is optional, so the probe type is passed in to make the
+    // lookup dependent
+    template<typename Probe, typename... Args>
+    static auto test_batch(int)
+        -> decltype(std::declval<Probe const&>().matches_batch(std::declval<Args>()...), std::true_type());
+
+    template<typename Probe, typename... Args>
+    static std::false_type test_batch(...);
+
+    // so is describe_mismatch, and describe may write to a stream or a
+    // writer; the first argument is what they are given to write to
+    template<typename Probe, typename... Args>
+    static auto test_mismatch(int)
+        -> decltype(std::declval<Probe const&>().describe_mismatch(std::declval<Args>()...), std::true_type());
+
+    template<typename Probe, typename... Args>
+    static std::false_type test_mismatch(...);
+
+    template<typename Probe, typename... Args>
+    static auto test_describe(int)
+        -> decltype(std::declval<Probe const&>().describe(std::declval<Args>()...), std::true_type());
+
+    template<typename Probe, typename... Args>
+    static std::false_type test_describe(...);
+};
+
+template<typename Policy, typename... Args>
+struct policy_accepts : decltype(policy_probe<Policy>::template test<Args...>(0))
+{ };
+
+template<typename Policy, typename... Args>
+struct policy_batches : decltype(policy_probe<Policy>::template test_batch<policy_probe<Policy>, Args...>(0))
+{ };
+
+template<typename Policy, typename... Args>
+struct policy_explains : decltype(policy_probe<Policy>::template test_mismatch<policy_probe<Policy>, Args...>(0))
+{ };
+
+template<typename Policy, typename... Args>
+struct policy_describes : decltype(policy_probe<Policy>::template test_describe<policy_probe<Policy>, Args...>(0))
+{ };
+
+} // namespace detail
+
+/*
+ * what descriptions and failure messages are formatted with, instead of
+ * iostreams: text is appended to a growable buffer, which the reporting
+ * functions keep per thread and reuse, and numbers are converted with
+ * std::to_chars, or by hand before C++17, in the format an ostream would use.
+ * Anything else is written with its insertion operator, through the ostream
+ * that stream() gives out; policies may describe themselves to either.
+ */
+class writer {
+public:
+    writer()
+    { }
+
+    writer(writer const&) = delete;
+    writer& operator=(writer const&) = delete;
+
+    void write(char const* s, std::size_t n) {
+        drain();
+        buffer_.append(s, n);
+    }
+
+    void put(char c) {
+        drain();
+        buffer_.push_back(c);
+    }
+
+    std::string const& str() const {
+        drain();
+        return buffer_;
+    }
+
+    std::size_t size() const {
+        drain();
+        return buffer_.size();
+    }
+
+    // empties the buffer, keeping what it has allocated
+    void clear() {
+        drain();
+        buffer_.clear();
+    }
+
+    // an ostream appending to the buffer, in its default state
+    std::ostream& stream() {
+        if (!stream_)
+            stream_.reset(new adapter(*this));
+        std::ostream& os = stream_->os;
+        os.clear();
+        os.flags(std::ios_base::dec | std::ios_base::skipws);
+        os.precision(6);
+        os.width(0);
+        os.fill(' ');
+        return os;
+    }
+
+private:
+    // numbers are put a character at a time, so the stream has a small
+    // buffer of its own, drained into the writer before it is written to
+    struct adapter : std::streambuf {
+        explicit adapter(writer& w) : w(w), os(this) {
+            setp(area, area + sizeof area);
+        }
+
+        void drain() {
+            if (pptr() != pbase()) {
+                w.buffer_.append(pbase(), pptr() - pbase());
+                setp(area, area + sizeof area);
+            }
+        }
+
+        int_type overflow(int_type c) {
+            drain();
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+                w.buffer_.push_back(traits_type::to_char_type(c));
+            return traits_type::not_eof(c);
+        }
+
+        std::streamsize xsputn(char const* s, std::streamsize n) {
+            drain();
+            w.buffer_.append(s, static_cast<std::size_t>(n));
+            return n;
+        }
+
+        int sync() {
+            drain();
+            return 0;
+        }
+
+        writer& w;
+        std::ostream os;
+        char area[256];
+    };
+
+    void drain() const {
+        if (stream_)
+            stream_->drain();
+    }
+
+    std::string buffer_;
+    std::unique_ptr<adapter> stream_;
+};
+
+namespace detail {
+
+// how a value is written: numbers and strings directly, anything else with
+// its insertion operator
+enum class write_kind { integer, floating, character, other };
+
+template<typename T>
+struct write_kind_of : std::integral_constant<write_kind,
+    std::is_same<T, char>::value || std::is_same<T, signed char>::value
+    || std::is_same<T, unsigned char>::value ? write_kind::character :
+    std::is_integral<T>::value ? write_kind::integer :
+    std::is_floating_point<T>::value ? write_kind::floating : write_kind::other>
+{ };
+
+template<typename T>
+typename std::make_unsigned<T>::type magnitude(T value, std::true_type) {
+    typedef typename std::make_unsigned<T>::type U;
+    return value < 0 ? U(0) - U(value) : U(value);
+}
+
+template<typename T>
+T magnitude(T value, std::false_type) {
+    return value;
+}
+
+template<typename T>
+void write_value(writer& w, T value, std::integral_constant<write_kind, write_kind::integer>) {
+    char buffer[std::numeric_limits<T>::digits10 + 3];
+#if __cplusplus >= 201703L
+    w.write(buffer, std::to_chars(buffer, buffer + sizeof buffer, value).ptr - buffer);
+#else
+    auto u = magnitude(value, std::is_signed<T>());
+    char* p = buffer + sizeof buffer;
+    do {
+        *--p = char('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (std::is_signed<T>::value && value < T(0))
+        *--p = '-';
+    w.write(p, buffer + sizeof buffer - p);
+#endif
+}
+
+// bools are numbers, as ostreams print them without std::boolalpha
+inline void write_value(writer& w, bool value, std::integral_constant<write_kind, write_kind::integer>) {
+    w.put(value ? '1' : '0');
+}
+
+// the %g of an ostream's default precision of 6
+template<typename T>
+void write_value(writer& w, T value, std::integral_constant<write_kind, write_kind::floating>) {
+    char buffer[64];
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    w.write(buffer, std::to_chars(buffer, buffer + sizeof buffer, value, std::chars_format::general, 6).ptr - buffer);
+#else
+    int n = std::is_same<T, long double>::value
+          ? std::snprintf(buffer, sizeof buffer, "%Lg", static_cast<long double>(value))
+          : std::snprintf(buffer, sizeof buffer, "%g", static_cast<double>(value));
+    w.write(buffer, n);
+#endif
+}
+
+template<typename T>
+void write_value(writer& w, T value, std::integral_constant<write_kind, write_kind::character>) {
+    w.put(static_cast<char>(value));
+}
+
+template<typename T>
+void write_value(writer& w, T const& value, std::integral_constant<write_kind, write_kind::other>) {
+    w.stream() << value;
+}
+
+} // namespace detail
+
+// a null C string is a value to report, not one to read
+inline writer& operator<<(writer& w, char const* s) {
+    if (s)
+        w.write(s, std::strlen(s));
+    else
+        w.write("(null)", 6);
+    return w;
+}
+
+inline writer& operator<<(writer& w, std::string const& s) {
+    w.write(s.data(), s.size());
+    return w;
+}
+
+inline writer& operator<<(writer& w, string_ref s) {
+    w.write(s.data(), s.size());
+    return w;
+}
+
+template<typename T>
+writer& operator<<(writer& w, T const& value) {
+    detail::write_value(w, value, detail::write_kind_of<T>());
+    return w;
+}
+
+template <typename T>
+std::string to_string(T const& val)
+{
+    writer out;
+    out << val;
+    return out.str();
+}
+
+/*
+ * without a test framework, failures are reported as whole records: each one
+ * is formatted into a buffer of the failing thread, then queued for a writer
+ * thread, so reports from several threads never interleave and don't contend
+ * for the console. The writer hands them to a sink, standard output unless
+ * set_report_sink() is given another one.
+ */
+typedef std::function<void(std::string const&)> report_sink;
+
+inline report_sink file_sink(std::FILE* file) {
+    return [file](std::string const& record) {
+        std::fwrite(record.data(), 1, record.size(), file);
+        std::fflush(file);
+    };
+}
+
+inline report_sink stdout_sink() {
+    return file_sink(stdout);
+}
+
+inline report_sink stderr_sink() {
+    return file_sink(stderr);
+}
+
+// appends to the file at path, which is closed along with the sink
+inline report_sink file_sink(std::string const& path) {
+    std::shared_ptr<std::FILE> file(std::fopen(path.c_str(), "a"), [](std::FILE* f) { if (f) std::fclose(f); });
+    if (!file)
+        throw std::runtime_error("cannot open report file " + path);
+    return [file](std::string const& record) {
+        std::fwrite(record.data(), 1, record.size(), file.get());
+        std::fflush(file.get());
+    };
+}
+
+namespace detail {
+
+// hands a formatted failure to the thread writing them to the sink
+MATCHA_INLINE void publish_report(std::string record);
+
+// each thread formats its failures in a buffer of its own
+inline writer& report_buffer() {
+    static thread_local writer buffer;
+    return buffer;
+}
+
+} // namespace detail
+
+MATCHA_INLINE void set_report_sink(report_sink sink);
+
+// returns once every failure reported so far has reached the sink
+MATCHA_INLINE void flush_reports();
+
+template<typename T>
+struct output_traits;
+
+template<>
+struct output_traits<bool>
+{
+    typedef bool result_type;
+
+    static bool success() {
+        return true;
+    }
+
+    static bool failure() {
+        return false;
+    }
+
+    static writer & ostream(bool &) {
+        writer& buffer = detail::report_buffer();
+        buffer.clear();
+        return buffer;
+    }
+
+    static void publish(bool &) {
+        detail::publish_report(detail::report_buffer().str());
+    }
+};
+
+#if defined(MATCHA_GTEST)
+
+template<>
+struct output_traits<::testing::AssertionResult>
+{
+    typedef ::testing::AssertionResult result_type;
+
+    static ::testing::AssertionResult success() {
+        return ::testing::AssertionSuccess();
+    }
+
+    static ::testing::AssertionResult failure() {
+        return ::testing::AssertionFailure();
+    }
+
+    static ::testing::AssertionResult & 
+    ostream(::testing::AssertionResult &result) {
+        return result;
+    }
+
+    static void publish(::testing::AssertionResult &) {
+    }
+};
+
+template<class T, class Matcher>
+::testing::AssertionResult
+assertResult(const char *, const char *, T const& actual, Matcher const& matcher) {
+    return assertResult<::testing::AssertionResult>(actual, matcher);
+}
+
+#elif defined(MATCHA_BOOSTTEST)
+
+template<>
+struct output_traits<boost::test_tools::predicate_result>
+{
+    typedef boost::test_tools::predicate_result result_type;
+
+    static bool success() { 
+        return true; 
+    }
+
+    static boost::test_tools::predicate_result failure() { 
+        return false; 
+    }
+
+    static decltype(std::declval<boost::test_tools::predicate_result>().message()) & 
+    ostream(boost::test_tools::predicate_result & result) {
+        return result.message();
+    }
+
+    static void publish(boost::test_tools::predicate_result &) {
+    }
+};
+
+#endif
+
+namespace detail {
+
+template<class T, class Matcher>
+writer& describe_failure(writer& w, T const& actual, Matcher const& matcher) {
+    w << '\n' << "Expected: " << matcher << '\n' << "but got : ";
+    matcher.describe_mismatch(w, actual);
+    w << '\n';
+    return w;
+}
+
+// the message is passed whole to the stream of a test framework
+template<class Stream, class T, class Matcher>
+Stream& describe_failure(Stream& os, T const& actual, Matcher const& matcher) {
+    writer& w = report_buffer();
+    w.clear();
+    os << describe_failure(w, actual, matcher).str();
+    return os;
+}
+
+// SFINAE type trait to detect whether a result type keeps failures to
+// describe them later
+
+template<typename Result, typename = void>
+struct defers : std::false_type
+{ };
+
+template<typename Result>
+struct defers<Result,
+    typename std::enable_if<true, decltype((void)&output_traits<Result>::template record<int, int>)>::type
+    > : std::true_type
+{ };
+
+template<class Result, class T, class Matcher>
+typename output_traits<Result>::result_type
+report(T const& actual, Matcher const& matcher, std::false_type) {
+    Result result = output_traits<Result>::failure();
+    describe_failure(output_traits<Result>::ostream(result), actual, matcher);
+    output_traits<Result>::publish(result);
+
+    return result;
+}
+
+template<class Result, class T, class Matcher>
+typename output_traits<Result>::result_type
+report(T const& actual, Matcher const& matcher, std::true_type) {
+    output_traits<Result>::record(actual, matcher);
+    return output_traits<Result>::failure();
+}
+
+
+#if defined(MATCHA_PROFILE)
+
+} // namespace detail
+
+// what the assertions of one call site have cost, in nanoseconds
+struct profile_entry {
+    std::string file;
+    int line;
+    std::string matcher;
+    std::uint64_t calls;
+    std::uint64_t failures;
+    double match_ns;
+    double report_ns;
+};
+
+namespace detail {
+
+// time stamp counter ticks, or else nanoseconds
+inline std::uint64_t profile_clock() {
+#if defined(MATCHA_PROFILE_TSC)
+    return __rdtsc();
+#else
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+inline std::uint64_t steady_nanoseconds() {
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// what an assertion site has cost so far
+struct profile_totals {
+    std::uint64_t calls;
+    std::uint64_t failures;
+    std::uint64_t match_ticks;
+    std::uint64_t report_ticks;
+};
+
+// the counters of a site on one thread, written by that thread only and
+// read by the report from any
+struct profile_counters {
+    std::atomic<std::uint64_t> calls;
+    std::atomic<std::uint64_t> failures;
+    std::atomic<std::uint64_t> match_ticks;
+    std::atomic<std::uint64_t> report_ticks;
+
+    void add(std::atomic<std::uint64_t>& counter, std::uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void add_to(profile_totals& totals) const {
+        totals.calls += calls.load(std::memory_order_relaxed);
+        totals.failures += failures.load(std::memory_order_relaxed);
+        totals.match_ticks += match_ticks.load(std::memory_order_relaxed);
+        totals.report_ticks += report_ticks.load(std::memory_order_relaxed);
+    }
+};
+
+class profile_thread;
+
+struct profile_site_info {
+    std::size_t id;
+    char const* file;
+    int line;
+    std::atomic<char const*> matcher;
+};
+
+/*
+ * every assertion site met, and the counters of every thread alive; those
+ * of the threads which have ended are added up into retired_
+ */
+class profile_registry {
+public:
+    profile_registry() : start_ticks_(profile_clock()), start_ns_(steady_nanoseconds())
+    { }
+
+    ~profile_registry();
+
+    profile_site_info* add_site(char const* file, int line) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sites_.emplace_back(new profile_site_info{sites_.size(), file, line, {nullptr}});
+        retired_.push_back(profile_totals());
+        return sites_.back().get();
+    }
+
+    void on_report(std::function<void(std::vector<profile_entry> const&)> report) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        report_ = std::move(report);
+    }
+
+    void attach(profile_thread* thread) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.push_back(thread);
+    }
+
+    void detach(profile_thread* thread);
+
+    // the totals of every site, with their site and matcher
+    template<typename F>
+    void collect(F&& f);
+
+    // nanoseconds per tick, measured over the run so far
+    double tick_ns() const {
+#if defined(MATCHA_PROFILE_TSC)
+        std::uint64_t const ticks = profile_clock() - start_ticks_;
+        std::uint64_t const ns = steady_nanoseconds() - start_ns_;
+        return ticks ? double(ns) / double(ticks) : 0.0;
+#else
+        return 1.0;
+#endif
+    }
+
+private:
+    std::mutex mutex_;
+    std::function<void(std::vector<profile_entry> const&)> report_;
+    std::vector<std::unique_ptr<profile_site_info>> sites_;
+    std::vector<profile_totals> retired_;
+    std::vector<profile_thread*> threads_;
+    std::uint64_t start_ticks_;
+    std::uint64_t start_ns_;
+};
+
+inline profile_registry& profile_sites() {
+    static profile_registry registry;
+    return registry;
+}
+
+// a call site of assertThat or checkThat, registered when first met
+class profile_site {
+public:
+    profile_site(char const* file, int line) : info_(profile_sites().add_site(file, line))
+    { }
+
+    profile_site_info& info() const {
+        return *info_;
+    }
+
+private:
+    profile_site_info* info_;
+};
+
+/*
+ * the counters of one thread, in pages allocated as sites are met so that
+ * the report can read them while more are added
+ */
+class profile_thread {
+public:
+    static constexpr std::size_t page_size = 256;
+    static constexpr std::size_t max_pages = 256;
+
+    profile_thread() {
+        for (auto& page : pages_)
+            page.store(nullptr, std::memory_order_relaxed);
+        profile_sites().attach(this);
+    }
+
+    profile_thread(profile_thread const&) = delete;
+    profile_thread& operator=(profile_thread const&) = delete;
+
+    ~profile_thread() {
+        profile_sites().detach(this);
+        for (auto& page : pages_)
+            delete[] page.load(std::memory_order_relaxed);
+    }
+
+    // nullptr past the last site counted
+    profile_counters* counters(std::size_t site) {
+        if (site >= page_size * max_pages)
+            return nullptr;
+        std::atomic<profile_counters*>& slot = pages_[site / page_size];
+        profile_counters* page = slot.load(std::memory_order_relaxed);
+        if (!page) {
+            page = new profile_counters[page_size]();
+            slot.store(page, std::memory_order_release);
+        }
+        return &page[site % page_size];
+    }
+
+    template<typename F>
+    void each(F&& f) const {
+        for (std::size_t p = 0; p != max_pages; ++p) {
+            profile_counters const* page = pages_[p].load(std::memory_order_acquire);
+            if (!page)
+                continue;
+            for (std::size_t i = 0; i != page_size; ++i)
+                f(p * page_size + i, page[i]);
+        }
+    }
+
+private:
+    std::atomic<profile_counters*> pages_[max_pages];
+};
+
+inline void profile_registry::detach(profile_thread* thread) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread->each([this](std::size_t site, profile_counters const& counters) {
+        if (site < retired_.size())
+            counters.add_to(retired_[site]);
+    });
+    threads_.erase(std::remove(threads_.begin(), threads_.end(), thread), threads_.end());
+}
+
+template<typename F>
+void profile_registry::collect(F&& f) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<profile_totals> totals(retired_);
+    for (profile_thread const* thread : threads_) {
+        thread->each([&totals](std::size_t site, profile_counters const& counters) {
+            if (site < totals.size())
+                counters.add_to(totals[site]);
+        });
+    }
+    for (std::size_t i = 0; i != sites_.size(); ++i)
+        f(*sites_[i], totals[i]);
+}
+
+inline profile_thread& this_profile_thread() {
+    static thread_local profile_thread thread;
+    return thread;
+}
+
+inline profile_site const*& current_profile_site() {
+    static thread_local profile_site const* site = nullptr;
+    return site;
+}
+
+inline void profile_here(profile_site const& site) {
+    current_profile_site() = &site;
+}
+
+
+// the policy of a matcher, by its name
+template<typename M>
+struct profile_type {
+    typedef M type;
+};
+
+template<typename Policy, typename Expected>
+struct profile_type<Matcher<Policy, Expected>> {
+    typedef Policy type;
+};
+
+// kept until the report at exit, after the destruction of other statics
+template<typename M>
+char const* profile_name() {
+    static std::string const* name = new std::string([] {
+        char const* mangled = typeid(typename profile_type<M>::type).name();
+#if defined(__GNUG__)
+        int status = 0;
+        std::unique_ptr<char, void (*)(void*)> demangled(
+            abi::__cxa_demangle(mangled, nullptr, nullptr, &status), std::free);
+        if (status == 0 && demangled)
+            return std::string(demangled.get());
+#endif
+        return std::string(mangled);
+    }());
+    return name->c_str();
+}
+
+/*
+ * times an assertion on behalf of the site last met on the thread: the
+ * match, and then the report of a failure until it goes out of scope
+ */
+class profile_timer {
+public:
+    template<typename M>
+    explicit profile_timer(M const*) : counters_(nullptr), failed_(false) {
+        profile_site const* site = current_profile_site();
+        current_profile_site() = nullptr;
+        if (!site)
+            return;
+        profile_site_info& info = site->info();
+        counters_ = this_profile_thread().counters(info.id);
+        if (!counters_)
+            return;
+        if (!info.matcher.load(std::memory_order_relaxed))
+            info.matcher.store(profile_name<M>(), std::memory_order_relaxed);
+        start_ = profile_clock();
+    }
+
+    profile_timer(profile_timer const&) = delete;
+    profile_timer& operator=(profile_timer const&) = delete;
+
+    bool matched(bool result) {
+        if (counters_) {
+            std::uint64_t const now = profile_clock();
+            counters_->add(counters_->calls, 1);
+            counters_->add(counters_->match_ticks, now - start_);
+            if (!result)
+                counters_->add(counters_->failures, 1);
+            start_ = now;
+        }
+        failed_ = !result;
+        return result;
+    }
+
+    ~profile_timer() {
+        if (counters_ && failed_)
+            counters_->add(counters_->report_ticks, profile_clock() - start_);
+    }
+
+private:
+    profile_counters* counters_;
+    std::uint64_t start_;
+    bool failed_;
+};
+
+inline std::vector<profile_entry> profile_entries(profile_registry& registry) {
+    std::vector<profile_entry> entries;
+    double const tick_ns = registry.tick_ns();
+    registry.collect([&](profile_site_info const& site, profile_totals const& totals) {
+        if (totals.calls == 0)
+            return;
+        char const* matcher = site.matcher.load(std::memory_order_relaxed);
+        entries.push_back(profile_entry{site.file, site.line, matcher ? matcher : "",
+                                        totals.calls, totals.failures,
+                                        double(totals.match_ticks) * tick_ns,
+                                        double(totals.report_ticks) * tick_ns});
+    });
+    std::stable_sort(entries.begin(), entries.end(), [](profile_entry const& a, profile_entry const& b) {
+        return a.match_ns + a.report_ns > b.match_ns + b.report_ns;
+    });
+    return entries;
+}
+
+} // namespace detail
+
+// the call sites met so far, the costliest first
+inline std::vector<profile_entry> profile_entries() {
+    return detail::profile_entries(detail::profile_sites());
+}
+
+/*
+ * the costliest call sites and matchers, e.g.
+ *
+ *   matcha profile: 12 sites, 40210 assertions, 812.402 ms
+ *        total ms      calls   failed    us/call  site
+ *         790.112      10000        0     79.011  test_merge.cpp:42 matcha::IsEqual
+ */
+inline void write_profile(writer& o, std::vector<profile_entry> const& entries, std::size_t top = 20) {
+    std::uint64_t calls = 0;
+    double total_ns = 0;
+    std::vector<profile_entry> matchers;
+    for (auto const& e : entries) {
+        calls += e.calls;
+        total_ns += e.match_ns + e.report_ns;
+        auto same = std::find_if(matchers.begin(), matchers.end(),
+                                 [&e](profile_entry const& m) { return m.matcher == e.matcher; });
+        if (same == matchers.end()) {
+            matchers.push_back(e);
+            continue;
+        }
+        same->calls += e.calls;
+        same->failures += e.failures;
+        same->match_ns += e.match_ns;
+        same->report_ns += e.report_ns;
+    }
+    std::stable_sort(matchers.begin(), matchers.end(), [](profile_entry const& a, profile_entry const& b) {
+        return a.match_ns + a.report_ns > b.match_ns + b.report_ns;
+    });
+
+    char line[128];
+    auto row = [&](profile_entry const& e) {
+        double const ns = e.match_ns + e.report_ns;
+        std::snprintf(line, sizeof line, "%16.3f %10llu %8llu %10.3f  ", ns / 1e6,
+                      static_cast<unsigned long long>(e.calls), static_cast<unsigned long long>(e.failures),
+                      ns / 1e3 / double(e.calls));
+        o << line;
+    };
+
+    std::snprintf(line, sizeof line, "%.3f", total_ns / 1e6);
+    o << "matcha profile: " << entries.size() << " sites, " << calls << " assertions, " << line << " ms\n";
+    o << "        total ms      calls   failed    us/call  site\n";
+    for (std::size_t i = 0; i != entries.size() && i != top; ++i) {
+        row(entries[i]);
+        o << entries[i].file << ":" << entries[i].line << " " << entries[i].matcher << "\n";
+    }
+    o << "        total ms      calls   failed    us/call  matcher\n";
+    for (std::size_t i = 0; i != matchers.size() && i != top; ++i) {
+        row(matchers[i]);
+        o << matchers[i].matcher << "\n";
+    }
+}
+
+// replaces the report written to stderr at exit
+inline void set_profile_report(std::function<void(std::vector<profile_entry> const&)> report) {
+    detail::profile_sites().on_report(std::move(report));
+}
+
+namespace detail {
+
+// the threads still running are counted as they stand
+inline profile_registry::~profile_registry() {
+    std::vector<profile_entry> const entries = profile_entries(*this);
+    if (report_) {
+        report_(entries);
+        return;
+    }
+    writer o;
+    write_profile(o, entries);
+    std::fputs(o.str().c_str(), stderr);
+}
+
+#endif // MATCHA_PROFILE
+
+} // namespace detail
+
+template<class Result, class T, class Matcher>
+typename output_traits<Result>::result_type
+assertResult(T const& actual, Matcher const& matcher) {
+#if defined(MATCHA_PROFILE)
+    detail::profile_timer timer(&matcher);
+    if (timer.matched(matcher.matches(actual)))
+        return output_traits<Result>::success();
+#else
+    // nothing is built on the passing path: result objects allocate
+    // their message storage, so they are only created on failure
+    if (matcher.matches(actual))
+        return output_traits<Result>::success();
+#endif
+
+    return detail::report<Result>(actual, matcher, detail::defers<Result>());
+}
+
+/*
+ * checkThat(actual, matcher) matches right away, but a failure only copies
+ * the matcher and the actual value into the arena of the innermost
+ * MatchaCollector of the thread. It is described when the collector is
+ * flushed or destroyed, so failures which are then dropped never cost any
+ * formatting. Matchers holding references, like those of arrays, must not
+ * outlive what they refer to before the collector is flushed.
+ *
+ * Without a collector, failures are reported right away.
+ */
+struct deferred { };
+
+namespace detail {
+
+struct check_location {
+    char const* file;
+    int line;
+};
+
+inline check_location& current_check() {
+    static thread_local check_location location = { "", 0 };
+    return location;
+}
+
+inline void check_site(char const* file, int line) {
+    current_check().file = file;
+    current_check().line = line;
+}
+
+// reports a failure described after the fact through the test framework,
+// or the reporter without one
+inline void report_collected(check_location const& location, std::string const& record,
+                             report_sink const& sink) {
+    if (sink) {
+        sink(std::string(location.file) + ':' + std::to_string(location.line) + ':' + record);
+        return;
+    }
+#if defined(MATCHA_GTEST)
+    ADD_FAILURE_AT(location.file, location.line) << record;
+#elif defined(MATCHA_BOOSTTEST)
+    // what BOOST_ERROR expands to, with the captured site instead of this one
+    (void)::boost::test_tools::tt_detail::report_assertion(
+        false, BOOST_TEST_LAZY_MSG(record), ::boost::unit_test::const_string(location.file),
+        static_cast<std::size_t>(location.line), ::boost::test_tools::tt_detail::CHECK,
+        ::boost::test_tools::tt_detail::CHECK_MSG, 0);
+#else
+    publish_report(std::string(location.file) + ':' + std::to_string(location.line) + ':' + record);
+#endif
+}
+
+// values are kept by copy, with arrays as containers of their copied items
+template<typename T>
+struct stored {
+    typedef T type;
+    static T const& store(T const& value) { return value; }
+};
+
+template<std::size_t N>
+struct stored<char[N]> {
+    typedef std::string type;
+    static std::string store(char const (&value)[N]) { return array_string(value).str(); }
+};
+
+template<typename T, std::size_t N>
+struct stored<T[N]> {
+    typedef std::vector<typename stored<T>::type> type;
+    static type store(T const (&value)[N]) { return type(std::begin(value), std::end(value)); }
+};
+
+struct collected_failure {
+    check_location location;
+
+    virtual ~collected_failure() { }
+    virtual void describe(writer& w) const = 0;
+};
+
+template<class T, class Matcher>
+struct collected_failure_of : collected_failure {
+    Matcher matcher;
+    typename stored<T>::type actual;
+
+    collected_failure_of(T const& a, Matcher const& m) : matcher(m), actual(stored<T>::store(a))
+    { }
+
+    void describe(writer& w) const {
+        describe_failure(w, actual, matcher);
+    }
+};
+
+// bump allocator freed as a whole
+class arena {
+public:
+    arena() : next_(nullptr), left_(0)
+    { }
+
+    void* allocate(std::size_t size) {
+        static const std::size_t align = alignof(std::max_align_t);
+        size = (size + align - 1) / align * align;
+        if (size > left_) {
+            std::size_t const block = std::max<std::size_t>(size, 64 * 1024);
+            blocks_.emplace_back(new char[block]);
+            next_ = blocks_.back().get();
+            left_ = block;
+        }
+        void* p = next_;
+        next_ += size;
+        left_ -= size;
+        return p;
+    }
+
+    void release() {
+        blocks_.clear();
+        next_ = nullptr;
+        left_ = 0;
+    }
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* next_;
+    std::size_t left_;
+};
+
+} // namespace detail
+
+class MatchaCollector {
+public:
+    // failures are reported through the test framework, or the reporter
+    // without one
+    MatchaCollector() : previous_(current())
+    {
+        current() = this;
+    }
+
+    // failures are given to sink, prefixed with their location
+    explicit MatchaCollector(report_sink sink) : sink_(std::move(sink)), previous_(current())
+    {
+        current() = this;
+    }
+
+    MatchaCollector(MatchaCollector const&) = delete;
+    MatchaCollector& operator=(MatchaCollector const&) = delete;
+
+    ~MatchaCollector() {
+        flush();
+        current() = previous_;
+    }
+
+    // failures held
+    std::size_t size() const {
+        return failures_.size();
+    }
+
+    // keeps only the first failure of each checkThat
+    void discard_repeated() {
+        std::set<std::pair<char const*, int>> seen;
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < failures_.size(); ++i) {
+            detail::check_location const& at = failures_[i]->location;
+            if (seen.insert(std::make_pair(at.file, at.line)).second)
+                failures_[kept++] = failures_[i];
+            else
+                failures_[i]->~collected_failure();
+        }
+        failures_.resize(kept);
+    }
+
+    // describes and reports up to limit failures, and how many were left out
+    void flush(std::size_t limit = std::size_t(-1)) {
+        writer& w = detail::report_buffer();
+        for (std::size_t i = 0; i < failures_.size() && i < limit; ++i) {
+            w.clear();
+            failures_[i]->describe(w);
+            detail::report_collected(failures_[i]->location, w.str(), sink_);
+        }
+        if (failures_.size() > limit) {
+            w.clear();
+            w << "\n" << failures_.size() - limit << " more failures left out\n";
+            detail::report_collected(failures_[limit]->location, w.str(), sink_);
+        }
+        clear();
+    }
+
+    // drops the failures held without describing them
+    void clear() {
+        for (detail::collected_failure* failure : failures_)
+            failure->~collected_failure();
+        failures_.clear();
+        arena_.release();
+    }
+
+    // the collector checkThat keeps failures in, if any
+    static MatchaCollector*& current() {
+        static thread_local MatchaCollector* collector = nullptr;
+        return collector;
+    }
+
+    template<class T, class Matcher>
+    void collect(T const& actual, Matcher const& matcher) {
+        typedef detail::collected_failure_of<T, Matcher> failure_type;
+        failure_type* failure = new (arena_.allocate(sizeof(failure_type))) failure_type(actual, matcher);
+        failure->location = detail::current_check();
+        failures_.push_back(failure);
+    }
+
+private:
+    report_sink sink_;
+    MatchaCollector* previous_;
+    detail::arena arena_;
+    std::vector<detail::collected_failure*> failures_;
+};
+
+template<>
+struct output_traits<deferred>
+{
+    typedef bool result_type;
+
+    static bool success() {
+        return true;
+    }
+
+    static bool failure() {
+        return false;
+    }
+
+    template<class T, class Matcher>
+    static void record(T const& actual, Matcher const& matcher) {
+        if (MatchaCollector* collector = MatchaCollector::current()) {
+            collector->collect(actual, matcher);
+            return;
+        }
+        writer& w = detail::report_buffer();
+        w.clear();
+        detail::report_collected(detail::current_check(), detail::describe_failure(w, actual, matcher).str(),
+                                 report_sink());
+    }
+};
+
+namespace detail {
+
+// std::ref and std::cref make a matcher hold a reference to its expected
+// value instead of a copy, the value then having to outlive the matcher
+template<typename T>
+struct unwrapped {
+    typedef T type;
+};
+
+template<typename T>
+struct unwrapped<std::reference_wrapper<T>> {
+    typedef typename std::remove_const<T>::type type;
+};
+
+template<typename T>
+constexpr T const& unwrap(T const& value) {
+    return value;
+}
+
+template<typename T>
+T const& unwrap(std::reference_wrapper<T> const& value) {
+    return value.get();
+}
+
+// what a policy describes to: the writer, or its ostream for policies which
+// only know of iostreams, and none when it can't explain a mismatch
+template<int Sink>
+using sink_kind = std::integral_constant<int, Sink>;
+
+template<typename Policy, typename... Args>
+struct describe_sink : sink_kind<policy_describes<Policy, writer&, Args...>::value ? 2 : 1>
+{ };
+
+template<typename Policy, typename... Args>
+struct mismatch_sink : sink_kind<
+    policy_explains<Policy, writer&, Args...>::value ? 2 :
+    policy_explains<Policy, std::ostream&, Args...>::value ? 1 : 0>
+{ };
+
+inline writer& sink(writer& w, sink_kind<2>) {
+    return w;
+}
+
+inline std::ostream& sink(writer& w, sink_kind<1>) {
+    return w.stream();
+}
+
+// the insertion operator of iostreams, formatting with a writer
+template<typename T>
+std::ostream& stream_out(std::ostream& o, T const& value) {
+    writer w;
+    w << value;
+    return o.write(w.str().data(), w.size());
+}
+
+} // namespace detail
+
+using std::ref;
+using std::cref;
+
+// ExpectedType is void by default, as declared in matcha-fwd.hpp
+template<class MatcherPolicy, class ExpectedType>
+class Matcher : public MatcherPolicy {
+    // what the policy is given, the referred value for std::ref and std::cref
+    typedef typename detail::unwrapped<ExpectedType>::type expected_value;
+public:
+    constexpr Matcher(ExpectedType const& value = ExpectedType()) : expected_(value)
+    { }
+
+    // std::move isn't constexpr in C++11
+    constexpr Matcher(ExpectedType&& value) : expected_(static_cast<ExpectedType&&>(value))
+    { }
+
+    template<class ActualType>
+    constexpr bool matches(ActualType const& actual) const {
+        return MatcherPolicy::matches(detail::unwrap(expected_), actual);
+    }
+
+    // what the matcher was built with
+    constexpr ExpectedType const& expected() const& {
+        return expected_;
+    }
+
+    MATCHA_CONSTEXPR14 ExpectedType&& expected() && {
+        return static_cast<ExpectedType&&>(expected_);
+    }
+
+    template<size_t M>
+    bool matches(char const (&actual)[M]) const {
+        return matches(detail::array_string(actual));
+    }
+
+    // strings are passed on as views, unless the policy only takes std::string
+    bool matches(string_ref actual) const {
+        return matches(actual, detail::policy_accepts<MatcherPolicy, expected_value const&, string_ref>());
+    }
+
+    // matches the n values at data at once, setting bit i of bits when
+    // data[i] matches; only for policies that provide a batch version
+    template<class T>
+    typename std::enable_if<
+        detail::policy_batches<MatcherPolicy, expected_value const&, T const*, std::size_t, match_word*>::value
+        >::type
+    matches_batch(T const* data, std::size_t n, match_word* bits) const {
+        MatcherPolicy::matches_batch(detail::unwrap(expected_), data, n, bits);
+    }
+
+    // describes actual for a failure message, the way the policy explains
+    // the mismatch, if it does
+    template<class ActualType>
+    void describe_mismatch(writer& o, ActualType const& actual) const {
+        describe_mismatch(o, actual, detail::mismatch_sink<MatcherPolicy, expected_value const&, ActualType const&>());
+    }
+
+    template<class ActualType>
+    void describe_mismatch(std::ostream& o, ActualType const& actual) const {
+        writer w;
+        describe_mismatch(w, actual);
+        o.write(w.str().data(), w.size());
+    }
+
+    friend writer& operator<<(writer& o, Matcher const& matcher) {
+        matcher.describe(detail::sink(o, detail::describe_sink<MatcherPolicy, expected_value const&>()),
+                         detail::unwrap(matcher.expected_));
+        return o;
+    }
+
+    friend std::ostream& operator<<(std::ostream& o, Matcher const& matcher) {
+        return detail::stream_out(o, matcher);
+    }
+private:
+    template<class ActualType, int Sink>
+    void describe_mismatch(writer& o, ActualType const& actual, detail::sink_kind<Sink> sink) const {
+        MatcherPolicy::describe_mismatch(detail::sink(o, sink), detail::unwrap(expected_), actual);
+    }
+
+    template<class ActualType>
+    void describe_mismatch(writer& o, ActualType const& actual, detail::sink_kind<0>) const {
+        o << actual;
+    }
+
+    bool matches(string_ref actual, std::true_type) const {
+        return MatcherPolicy::matches(detail::unwrap(expected_), actual);
+    }
+
+    bool matches(string_ref actual, std::false_type) const {
+        return MatcherPolicy::matches(detail::unwrap(expected_), actual.str());
+    }
+
+    ExpectedType expected_;
+};
+
+// there is no expected value, for matcher not taking input parameters
+template<class MatcherPolicy>
+class Matcher<MatcherPolicy,void> : public MatcherPolicy {
+public:
+    template<class ActualType>
+    constexpr bool matches(ActualType const& actual) const {
+        return MatcherPolicy::matches(actual);
+    }
+
+    template<size_t M>
+    bool matches(char const (&actual)[M]) const {
+        return matches(detail::array_string(actual));
+    }
+
+    bool matches(string_ref actual) const {
+        return matches(actual, detail::policy_accepts<MatcherPolicy, string_ref>());
+    }
+
+    template<class ActualType>
+    void describe_mismatch(writer& o, ActualType const& actual) const {
+        describe_mismatch(o, actual, detail::mismatch_sink<MatcherPolicy, ActualType const&>());
+    }
+
+    template<class ActualType>
+    void describe_mismatch(std::ostream& o, ActualType const& actual) const {
+        detail::stream_out(o, actual);
+    }
+
+    friend writer& operator<<(writer& o, Matcher const& matcher) {
+        matcher.describe(detail::sink(o, detail::describe_sink<MatcherPolicy>()));
+        return o;
+    }
+
+    friend std::ostream& operator<<(std::ostream& o, Matcher const& matcher) {
+        return detail::stream_out(o, matcher);
+    }
+private:
+    template<class ActualType, int Sink>
+    void describe_mismatch(writer& o, ActualType const& actual, detail::sink_kind<Sink> sink) const {
+        MatcherPolicy::describe_mismatch(detail::sink(o, sink), actual);
+    }
+
+    template<class ActualType>
+    void describe_mismatch(writer& o, ActualType const& actual, detail::sink_kind<0>) const {
+        o << actual;
+    }
+
+    bool matches(string_ref actual, std::true_type) const {
+        return MatcherPolicy::matches(actual);
+    }
+
+    bool matches(string_ref actual, std::false_type) const {
+        return MatcherPolicy::matches(actual.str());
+    }
+};
+
+// C-style arrays and strings
+template<class MatcherPolicy, class ExpectedType, size_t N>
+class Matcher<MatcherPolicy,ExpectedType[N]> : public MatcherPolicy
+{
+public:
+    Matcher(ExpectedType const (&value)[N]) : expected_(value)
+    { }
+
+    // arrays, std::array and contiguous containers are compared as views,
+    // anything else (e.g. the item looked up by in()) is passed on as is
+    template<class ActualType>
+    bool matches(ActualType const& actual) const {
+        return matches(actual, std::is_convertible<ActualType const&, view_type>());
+    }
+
+    template<size_t M>
+    bool matches(char const (&actual)[M]) const {
+        return matches(detail::array_string(actual));
+    }
+
+    template<class ActualType>
+    void describe_mismatch(writer& o, ActualType const& actual) const {
+        describe_mismatch(o, actual, detail::sink_kind<
+            std::is_convertible<ActualType const&, view_type>::value
+            ? detail::mismatch_sink<MatcherPolicy, view_type, view_type>::value : 0>());
+    }
+
+    template<class ActualType>
+    void describe_mismatch(std::ostream& o, ActualType const& actual) const {
+        writer w;
+        describe_mismatch(w, actual);
+        o.write(w.str().data(), w.size());
+    }
+
+    friend writer& operator<<(writer& o, Matcher const& matcher) {
+        matcher.describe(detail::sink(o, detail::describe_sink<MatcherPolicy, ExpectedType const (&)[N]>()),
+                         matcher.expected_);
+        return o;
+    }
+
+    friend std::ostream& operator<<(std::ostream& o, Matcher const& matcher) {
+        return detail::stream_out(o, matcher);
+    }
+private:
+    // char arrays hold strings
+    typedef typename std::conditional<
+        std::is_same<ExpectedType, char>::value, string_ref, array_ref<ExpectedType>
+        >::type view_type;
+
+    template<class ActualType, int Sink>
+    void describe_mismatch(writer& o, ActualType const& actual, detail::sink_kind<Sink> sink) const {
+        MatcherPolicy::describe_mismatch(detail::sink(o, sink), view(expected_), view_type(actual));
+    }
+
+    template<class ActualType>
+    void describe_mismatch(writer& o, ActualType const& actual, detail::sink_kind<0>) const {
+        o << actual;
+    }
+
+    template<class ActualType>
+    bool matches(ActualType const& actual, std::true_type) const {
+        return MatcherPolicy::matches(view(expected_), view_type(actual));
+    }
+
+    template<class ActualType>
+    bool matches(ActualType const& actual, std::false_type) const {
+        return MatcherPolicy::matches(view(expected_), actual);
+    }
+
+    static string_ref view(char const (&value)[N]) {
+        return detail::array_string(value);
+    }
+
+    template<typename T>
+    static array_ref<T> view(T const (&value)[N]) {
+        return array_ref<T>(value);
+    }
+
+    ExpectedType const (&expected_)[N];
+};
+
+// this is just sugar to make it easy to create a matcher
+// still preferred to use a free function though
+
+template<class MatcherPolicy>
+struct MatcherGenerator {
+
+    template<typename... T>
+    constexpr Matcher<MatcherPolicy,T...> operator()(T const& ...value) const {
+        return Matcher<MatcherPolicy,T...>(value...); 
+    }
+
+    // temporaries, typically other matchers, are moved in rather than copied
+    template<typename T, typename = typename std::enable_if<
+        !std::is_reference<T>::value && !std::is_const<T>::value>::type>
+    constexpr Matcher<MatcherPolicy,T> operator()(T&& value) const {
+        return Matcher<MatcherPolicy,T>(static_cast<T&&>(value));
+    }
+
+    template<typename T, size_t N>
+    Matcher<MatcherPolicy,T[N]> operator()(T const (&value)[N]) const {
+        return Matcher<MatcherPolicy,T[N]>(value);
+    }
+};
+
+template<class MatcherPolicy>
+constexpr MatcherGenerator<MatcherPolicy> make_matcher() {
+    return MatcherGenerator<MatcherPolicy>();
+}
+
+
+
+
+// SFINAE type trait to detect whether one or more classes are matchers
+
+template<typename... Ts>
+struct is_matcher : std::false_type 
+{ };
+
+template<typename T>
+struct is_matcher<T> : is_specialization_of<Matcher,T> 
+{ };
+
+template<typename First, typename... Rest>
+struct is_matcher<First, Rest...>
+    : std::integral_constant<
+        bool,
+        is_matcher<First>::value && is_matcher<Rest...>::value
+      >
+{ };
+
+/*
+ * what a matcher roughly costs to evaluate, for anyOf and allOf to try their
+ * cheapest operands first. A policy gives its cost with a static member,
+ *
+ *   static constexpr match_cost cost = cost_expensive;
+ *
+ * or, if it depends on the expected value, by specializing matcher_cost.
+ * Policies which do neither are taken as medium.
+ */
+enum match_cost : unsigned {
+    cost_cheap = 1,         // comparisons of values
+    cost_medium = 10,       // scans of strings, lookups
+    cost_expensive = 100    // regular expressions, walks over containers
+};
+
+template<typename Policy, typename ExpectedType, typename = void>
+struct matcher_cost : std::integral_constant<unsigned, cost_medium>
+{ };
+
+template<typename Policy, typename ExpectedType>
+struct matcher_cost<Policy, ExpectedType,
+    typename std::enable_if<true, decltype((void)Policy::cost)>::type
+    > : std::integral_constant<unsigned, Policy::cost>
+{ };
+
+namespace detail {
+
+// std::index_sequence is C++14
+
+#if __cplusplus >= 201402L
+
+using std::index_sequence;
+using std::make_index_sequence;
+
+#else
+
+template<std::size_t... I>
+struct index_sequence
+{ };
+
+template<typename First, typename Second>
+struct concat_sequence;
+
+template<std::size_t... I, std::size_t... J>
+struct concat_sequence<index_sequence<I...>, index_sequence<J...>> {
+    typedef index_sequence<I..., sizeof...(I) + J...> type;
+};
+
+// built by halves, so that long sequences take log N instantiations
+template<std::size_t N>
+struct make_index_sequence_ : concat_sequence<
+    typename make_index_sequence_<N / 2>::type,
+    typename make_index_sequence_<N - N / 2>::type>
+{ };
+
+template<>
+struct make_index_sequence_<0> {
+    typedef index_sequence<> type;
+};
+
+template<>
+struct make_index_sequence_<1> {
+    typedef index_sequence<0> type;
+};
+
+template<std::size_t N>
+using make_index_sequence = typename make_index_sequence_<N>::type;
+
+#endif
+
+template<typename T>
+struct is_string : std::false_type
+{ };
+
+template<typename C, typename Traits, typename Alloc>
+struct is_string<std::basic_string<C, Traits, Alloc>> : std::true_type
+{ };
+
+template<>
+struct is_string<string_ref> : std::true_type
+{ };
+
+template<typename M>
+struct cost_of;
+
+template<typename Policy, typename ExpectedType>
+struct cost_of<Matcher<Policy, ExpectedType>>
+    : matcher_cost<Policy, typename unwrapped<ExpectedType>::type>
+{ };
+
+constexpr unsigned cost_sum() {
+    return 0;
+}
+
+template<typename... Rest>
+constexpr unsigned cost_sum(unsigned first, Rest... rest) {
+    return first + cost_sum(rest...);
+}
+
+// how many of the costs come before the i-th one, cost being the i-th, in
+// a stable sort
+constexpr std::size_t cost_rank(unsigned, std::size_t, std::size_t) {
+    return 0;
+}
+
+template<typename... Rest>
+constexpr std::size_t cost_rank(unsigned cost, std::size_t i, std::size_t j, unsigned other, Rest... rest) {
+    return (other < cost || (other == cost && j < i)) + cost_rank(cost, i, j + 1, rest...);
+}
+
+// the position holding rank, among the ranks
+constexpr std::size_t ranked(std::size_t, std::size_t) {
+    return 0;
+}
+
+template<typename... Rest>
+constexpr std::size_t ranked(std::size_t rank, std::size_t j, std::size_t first, Rest... rest) {
+    return first == rank ? j : ranked(rank, j + 1, rest...);
+}
+
+template<typename Seq, unsigned... Cost>
+struct by_cost_;
+
+template<std::size_t... I, unsigned... Cost>
+struct by_cost_<index_sequence<I...>, Cost...> {
+    typedef index_sequence<ranked(I, 0, cost_rank(Cost, I, 0, Cost...)...)...> type;
+};
+
+// the indices of the matchers, from the cheapest to the most expensive
+template<typename... M>
+using by_cost = typename by_cost_<make_index_sequence<sizeof...(M)>, cost_of<M>::value...>::type;
+
+} // namespace detail
+
+/*
+ * bulk matching over ranges: matchAll(range, matcher) tells whether every
+ * element matches, countMatches(range, matcher) how many do, and
+ * firstMismatch(range, matcher) the position of the first one that doesn't
+ * (the size of the range if there is none).
+ *
+ * contiguous ranges of float or double are matched in batches, with
+ * vectorized kernels, when the matcher provides matches_batch
+ */
+
+namespace detail {
+
+// elements matched per call to matches_batch
+static const std::size_t batch_elements = 4096;
+
+template<typename M, typename T, typename = void>
+struct has_batch : std::false_type
+{ };
+
+template<typename M, typename T>
+struct has_batch<M, T,
+    typename std::enable_if<
+        true,
+        decltype((std::declval<M const&>().matches_batch(std::declval<T const*>(),
+                                                         std::size_t(),
+                                                         std::declval<match_word*>())), (void)0)
+        >::type
+    > : std::true_type
+{ };
+
+template<typename T, typename... Ms>
+struct all_have_batch : std::true_type
+{ };
+
+template<typename T, typename First, typename... Rest>
+struct all_have_batch<T, First, Rest...>
+    : std::integral_constant<
+        bool,
+        has_batch<First, T>::value && all_have_batch<T, Rest...>::value
+      >
+{ };
+
+// batches only pay off with vector kernels, elsewhere matching one element
+// at a time is as fast
+template<typename C>
+struct is_batchable : std::integral_constant<
+    bool,
+    simd_lanes<typename range_value<C>::type>::enabled
+    && std::is_convertible<C const&, array_ref<typename range_value<C>::type>>::value>
+{ };
+
+// bits set in the first n bits of the words of a batch
+inline std::size_t count_bits(match_word const* bits, std::size_t n) {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < n / match_word_bits; ++i)
+        count += popcount(bits[i]);
+    if (n % match_word_bits)
+        count += popcount(bits[n / match_word_bits] & ((match_word(1) << (n % match_word_bits)) - 1));
+    return count;
+}
+
+// position of the first clear bit among the first n bits, n if there is none
+inline std::size_t first_clear_bit(match_word const* bits, std::size_t n) {
+    for (std::size_t i = 0; i < n; i += match_word_bits) {
+        match_word unset = ~bits[i / match_word_bits];
+        if (n - i < match_word_bits)
+            unset &= (match_word(1) << (n - i)) - 1;
+        if (unset)
+            return i + first_set_bit(unset);
+    }
+    return n;
+}
+
+// counts the matches and finds the position of the first mismatch (the size
+// of the range if there is none), stopping there if asked to; returns
+// whether every element matched
+template<typename T, typename M>
+bool batch_scan(array_ref<T> values, M const& matcher, bool stop,
+                std::size_t& count, std::size_t& mismatch) {
+    match_word bits[batch_elements / match_word_bits];
+    mismatch = values.size();
+    for (std::size_t i = 0; i < values.size(); i += batch_elements) {
+        std::size_t const len = std::min(batch_elements, values.size() - i);
+        matcher.matches_batch(values.data() + i, len, bits);
+        if (mismatch == values.size()) {
+            std::size_t const pos = first_clear_bit(bits, len);
+            if (pos != len) {
+                mismatch = i + pos;
+                if (stop)
+                    return false;
+            }
+        }
+        count += count_bits(bits, len);
+    }
+    return mismatch == values.size();
+}
+
+template<typename C, typename M>
+bool scan(C const& cont, M const& matcher, bool stop,
+          std::size_t& count, std::size_t& mismatch, std::false_type) {
+    std::size_t pos = 0;
+    bool found = false;
+    for (auto const& item : cont) {
+        if (matcher.matches(item)) {
+            ++count;
+        } else if (!found) {
+            found = true;
+            mismatch = pos;
+            if (stop)
+                return false;
+        }
+        ++pos;
+    }
+    if (!found)
+        mismatch = pos;
+    return !found;
+}
+
+template<typename C, typename M>
+bool scan(C const& cont, M const& matcher, bool stop,
+          std::size_t& count, std::size_t& mismatch, std::true_type) {
+    typedef typename range_value<C>::type value_type;
+    return batch_scan(array_ref<value_type>(cont), matcher, stop, count, mismatch);
+}
+
+template<typename C, typename M>
+bool scan(C const& cont, M const& matcher, bool stop, std::size_t& count, std::size_t& mismatch) {
+    typedef typename range_value<C>::type value_type;
+    return scan(cont, matcher, stop, count, mismatch,
+                std::integral_constant<bool, is_batchable<C>::value && has_batch<M, value_type>::value>());
+}
+
+} // namespace detail
+
+template<typename C, typename M>
+bool matchAll(C const& cont, M const& matcher) {
+    static_assert(is_matcher<M>::value, "matchAll requires a Matcher parameter");
+    std::size_t count = 0, mismatch = 0;
+    return detail::scan(cont, matcher, true, count, mismatch);
+}
+
+template<typename C, typename M>
+std::size_t countMatches(C const& cont, M const& matcher) {
+    static_assert(is_matcher<M>::value, "countMatches requires a Matcher parameter");
+    std::size_t count = 0, mismatch = 0;
+    detail::scan(cont, matcher, false, count, mismatch);
+    return count;
+}
+
+template<typename C, typename M>
+std::size_t firstMismatch(C const& cont, M const& matcher) {
+    static_assert(is_matcher<M>::value, "firstMismatch requires a Matcher parameter");
+    std::size_t count = 0, mismatch = 0;
+    detail::scan(cont, matcher, true, count, mismatch);
+    return mismatch;
+}
+
+struct Is {
+protected:
+    template<typename MatcherType, typename ActualType>
+    constexpr bool matches(MatcherType const& expected, ActualType const& actual) const {
+        static_assert(is_matcher<MatcherType>::value, "IsNot matcher requires a Matcher parameter");
+        return expected.matches(actual);
+    }
+
+    template<typename MatcherType, typename T>
+    auto matches_batch(MatcherType const& expected, T const* data, std::size_t n, match_word* bits) const
+        -> decltype(expected.matches_batch(data, n, bits))
+    {
+        return expected.matches_batch(data, n, bits);
+    }
+
+    template<typename MatcherType, typename ActualType>
+    void describe_mismatch(writer& o, MatcherType const& expected, ActualType const& actual) const {
+        expected.describe_mismatch(o, actual);
+    }
+
+    template<typename MatcherType>
+    void describe(writer& o, MatcherType const& expected) const {
+        o << "is " << expected;
+    }
+};
+
+constexpr auto is = make_matcher<Is>();
+
 struct IsNot_ {
 protected:
-    template<typename MatcherType, typename ActualType>
-    bool matches(MatcherType const& expected, ActualType const& actual) const {
-        return !expected.matches(actual);
+    template<typename MatcherType, typename ActualType>
+    constexpr bool matches(MatcherType const& expected, ActualType const& actual) const {
+        return !expected.matches(actual);
+    }
+
+    template<typename MatcherType, typename T>
+    auto matches_batch(MatcherType const& expected, T const* data, std::size_t n, match_word* bits) const
+        -> decltype(expected.matches_batch(data, n, bits))
+    {
+        expected.matches_batch(data, n, bits);
+        for (std::size_t i = 0; i < n; i += detail::match_word_bits)
+            bits[i / detail::match_word_bits] = ~bits[i / detail::match_word_bits];
+    }
+
+    template<typename MatcherType>
+    void describe(writer& o, MatcherType const& expected) const {
+        o << "not " << expected;
+    }
+};
+
+template<class T>
+using IsNot = Matcher<IsNot_,T>;
+
+template<typename Policy, typename ExpectedType>
+struct matcher_cost<Is, Matcher<Policy, ExpectedType>> : detail::cost_of<Matcher<Policy, ExpectedType>>
+{ };
+
+template<typename Policy, typename ExpectedType>
+struct matcher_cost<IsNot_, Matcher<Policy, ExpectedType>> : detail::cost_of<Matcher<Policy, ExpectedType>>
+{ };
+
+
+template<class T>
+constexpr typename std::enable_if<is_matcher<T>::value, IsNot<T>>::type
+operator!(T const& value) {
+    return IsNot<T>(value);
+}
+
+template<class T>
+constexpr typename std::enable_if<is_matcher<T>::value && !std::is_reference<T>::value, IsNot<T>>::type
+operator!(T&& value) {
+    return IsNot<T>(static_cast<T&&>(value));
+}
+
+struct IsNull {
+    static constexpr match_cost cost = cost_cheap;
+
+protected:
+    template<typename T>
+    bool matches(T const* actual) const {
+        return actual == nullptr;
+    }
+
+    void describe(writer& o) const {
+        o << "null pointer";
+    }
+};
+
+constexpr auto null = make_matcher<IsNull>();
+
+
+/*
+ * a single-pass sequence, e.g. the records of a file read with
+ * std::istream_iterator, matched by everyItem, contains, empty and hasSize
+ * as it is read without being stored: they stop at the first item which
+ * settles the match, and the range remembers that item and its offset for
+ * the failure message, "-1 at offset 1000", or how many items it had when
+ * it ran out. Matching again goes on reading from there, which is why it
+ * can't be matched by anyOf or allOf: each operand would read on from where
+ * the one tried before it stopped.
+ *
+ *   assertThat(inputRange(std::istream_iterator<int>(in), std::istream_iterator<int>()),
+ *              everyItem(greaterThan(0)));
+ */
+template<typename It, typename Sentinel = It>
+class input_range {
+public:
+    typedef typename std::decay<decltype(*std::declval<It&>())>::type item_type;
+
+    input_range(It first, Sentinel last)
+        : first_(std::move(first)), last_(std::move(last)), offset_(0), stopped_(false)
+    { }
+
+    // reads items until pred holds for one, which is then kept in mind;
+    // returns whether one did
+    template<typename Pred>
+    bool find(Pred&& pred) const {
+        for (; first_ != last_; ++first_, ++offset_) {
+            if (pred(*first_)) {
+                writer w;
+                w << *first_;
+                item_ = w.str();
+                stopped_ = true;
+                ++first_;
+                ++offset_;
+                return true;
+            }
+        }
+        stopped_ = false;
+        return false;
+    }
+
+    // items read so far
+    std::size_t offset() const {
+        return offset_;
+    }
+
+    friend writer& operator<<(writer& o, input_range const& range) {
+        if (range.stopped_)
+            o << range.item_ << " at offset " << range.offset_ - 1;
+        else
+            o << range.offset_ << (range.offset_ == 1 ? " item" : " items");
+        return o;
+    }
+
+    friend std::ostream& operator<<(std::ostream& o, input_range const& range) {
+        return detail::stream_out(o, range);
+    }
+
+private:
+    mutable It first_;
+    Sentinel last_;
+    mutable std::size_t offset_;
+    mutable bool stopped_;
+    mutable std::string item_;
+};
+
+template<typename It, typename Sentinel>
+input_range<It, Sentinel> inputRange(It first, Sentinel last) {
+    return input_range<It, Sentinel>(std::move(first), std::move(last));
+}
+
+namespace detail {
+
+// whether T is consumed as it is matched, and so can only be matched once
+template<typename T>
+struct single_pass : std::false_type
+{ };
+
+template<typename It, typename S>
+struct single_pass<input_range<It, S>> : std::true_type
+{ };
+
+// the items of a generator, a callable filling in its argument with the next
+// item and returning false when there are no more
+template<typename T, typename Generator>
+class generator_iterator {
+public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef T const* pointer;
+    typedef T const& reference;
+
+    explicit generator_iterator(Generator generator)
+        : generator_(std::move(generator)), value_(), done_(false)
+    {
+        ++*this;
+    }
+
+    T const& operator*() const {
+        return value_;
+    }
+
+    generator_iterator& operator++() {
+        done_ = !generator_(value_);
+        return *this;
+    }
+
+    bool done() const {
+        return done_;
+    }
+
+private:
+    Generator generator_;
+    T value_;
+    bool done_;
+};
+
+struct generator_end
+{ };
+
+template<typename T, typename Generator>
+bool operator!=(generator_iterator<T, Generator> const& it, generator_end) {
+    return !it.done();
+}
+
+// holds from the item after the n-th on
+struct past_count {
+    std::size_t n;
+    std::size_t seen;
+
+    template<typename T>
+    bool operator()(T const&) {
+        return ++seen > n;
+    }
+};
+
+template<typename M>
+struct mismatching {
+    M const& matcher;
+
+    template<typename T>
+    bool operator()(T const& item) const {
+        return !matcher.matches(item);
+    }
+};
+
+template<typename T>
+struct equal_to_item {
+    T const& item;
+
+    template<typename U>
+    bool operator()(U const& value) const {
+        return value == item;
+    }
+};
+
+struct any_item {
+    template<typename T>
+    bool operator()(T const&) const {
+        return true;
+    }
+};
+
+} // namespace detail
+
+// the items of a generator of T, e.g. inputRange<int>([&](int& n) { return bool(in >> n); })
+template<typename T, typename Generator>
+input_range<detail::generator_iterator<T, Generator>, detail::generator_end> inputRange(Generator generator) {
+    return input_range<detail::generator_iterator<T, Generator>, detail::generator_end>(
+        detail::generator_iterator<T, Generator>(std::move(generator)), detail::generator_end());
+}
+
+namespace detail {
+
+// the bytes of a file, mapped if it is a regular one, and else (pipes,
+// character devices, files of /proc with no size) read in chunks
+class file_bytes {
+public:
+    // throws std::runtime_error when the file can't be opened
+    explicit file_bytes(std::string const& path);
+
+    file_bytes(file_bytes const&) = delete;
+    file_bytes& operator=(file_bytes const&) = delete;
+
+    ~file_bytes();
+
+    string_ref view() const {
+        return string_ref(data_, size_);
+    }
+
+private:
+    char const* data_;
+    std::size_t size_;
+    bool mapped_;
+    std::string buffer_;
+};
+
+// the lines of a text, without their line feed; a last one ending the text
+// without a line feed still counts
+class line_iterator {
+public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef string_ref value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef string_ref const* pointer;
+    typedef string_ref const& reference;
+
+    line_iterator(std::shared_ptr<file_bytes const> bytes)
+        : bytes_(std::move(bytes)), next_(0)
+    {
+        ++*this;
+    }
+
+    string_ref const& operator*() const {
+        return line_;
+    }
+
+    line_iterator& operator++() {
+        string_ref const text = bytes_->view();
+        done_ = next_ >= text.size();
+        if (!done_) {
+            void const* feed = std::memchr(text.data() + next_, '\n', text.size() - next_);
+            std::size_t const end = feed ? static_cast<char const*>(feed) - text.data() : text.size();
+            line_ = text.substr(next_, end - next_);
+            next_ = end + 1;
+        }
+        return *this;
+    }
+
+    bool done() const {
+        return done_;
+    }
+
+private:
+    std::shared_ptr<file_bytes const> bytes_;
+    std::size_t next_;
+    string_ref line_;
+    bool done_;
+};
+
+struct line_end
+{ };
+
+inline bool operator!=(line_iterator const& it, line_end) {
+    return !it.done();
+}
+
+} // namespace detail
+
+/*
+ * the contents of a file, for golden-file tests, as an actual value or as an
+ * expected one of equalTo, contains, startsWith, endsWith and matchesPattern:
+ *
+ *   assertThat(fileContents("out.txt"), equalTo(fileContents("golden.txt")));
+ *   assertThat(fileContents("out.txt").lines(), everyItem(startsWith("ok ")));
+ *
+ * Regular files are mapped into memory and compared in place. They are
+ * described by name and size, and an equalTo failure shows where the
+ * contents first differ. Copies share the contents, which stay mapped as
+ * long as one of them does.
+ */
+class file_contents {
+public:
+    explicit file_contents(std::string path)
+        : path_(std::move(path)), bytes_(std::make_shared<detail::file_bytes const>(path_))
+    { }
+
+    string_ref view() const {
+        return bytes_->view();
+    }
+
+    operator string_ref() const {
+        return view();
+    }
+
+    std::size_t size() const {
+        return view().size();
+    }
+
+    std::string const& path() const {
+        return path_;
+    }
+
+    // the lines, for everyItem to tell which one doesn't match
+    input_range<detail::line_iterator, detail::line_end> lines() const {
+        return input_range<detail::line_iterator, detail::line_end>(detail::line_iterator(bytes_), detail::line_end());
+    }
+
+    friend writer& operator<<(writer& o, file_contents const& file) {
+        return o << "the contents of " << file.path_ << " (" << file.size() << " bytes)";
+    }
+
+    friend std::ostream& operator<<(std::ostream& o, file_contents const& file) {
+        return detail::stream_out(o, file);
+    }
+
+private:
+    std::string path_;
+    std::shared_ptr<detail::file_bytes const> bytes_;
+};
+
+// throws std::runtime_error when the file can't be opened
+inline file_contents fileContents(std::string path) {
+    return file_contents(std::move(path));
+}
+
+namespace detail {
+
+// offset of the first byte in which two texts differ, the size of the
+// shortest if one begins the other; whole blocks are compared with memcmp
+inline std::size_t first_difference(string_ref a, string_ref b) {
+    static const std::size_t block = 4096;
+    std::size_t const n = std::min(a.size(), b.size());
+    std::size_t i = 0;
+    while (i + block <= n && !std::memcmp(a.data() + i, b.data() + i, block))
+        i += block;
+    while (i < n && a[i] == b[i])
+        ++i;
+    return i;
+}
+
+// a few bytes of text around pos, quoted and with control characters escaped
+inline void write_excerpt(writer& o, string_ref text, std::size_t pos) {
+    static const std::size_t radius = 16;
+    std::size_t const first = pos > radius ? pos - radius : 0;
+    string_ref const excerpt = text.substr(first, pos - first + radius);
+    o << (first > 0 ? "\"..." : "\"");
+    for (char c : excerpt) {
+        if (c == '\n')
+            o << "\\n";
+        else if (c == '\t')
+            o << "\\t";
+        else if (c == '\r')
+            o << "\\r";
+        else
+            o.put(c);
+    }
+    o << (first + excerpt.size() < text.size() ? "...\"" : "\"");
+}
+
+// where the contents of text differ from those expected: the byte, line and
+// column of the first difference, and the text around it on both sides
+inline void describe_text_difference(writer& o, string_ref expected, string_ref actual) {
+    std::size_t const pos = first_difference(expected, actual);
+    std::size_t const line = 1 + std::count(actual.begin(), actual.begin() + pos, '\n');
+    std::size_t column = pos;
+    for (std::size_t i = pos; i > 0; --i) {
+        if (actual[i - 1] == '\n') {
+            column = pos - i;
+            break;
+        }
+    }
+    o << ", differing at byte " << pos << " (line " << line << ", column " << column + 1 << "): ";
+    write_excerpt(o, actual, pos);
+    o << " instead of ";
+    write_excerpt(o, expected, pos);
+}
+
+template<typename T>
+struct is_file : std::is_same<T, file_contents>
+{ };
+
+} // namespace detail
+
+namespace detail {
+
+inline std::uint64_t rotl64(std::uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline std::uint64_t load64(char const* p) {
+    std::uint64_t x;
+    std::memcpy(&x, p, sizeof x);
+    return x;
+}
+
+inline std::uint32_t load32(char const* p) {
+    std::uint32_t x;
+    std::memcpy(&x, p, sizeof x);
+    return x;
+}
+
+// XXH64 of n bytes, four independent lanes of 8 bytes each per round, for
+// the hashes of snapshots; byte order is the machine's, a hash computed on
+// another one only costs a full comparison
+inline std::uint64_t hash_bytes(char const* data, std::size_t n, std::uint64_t seed = 0) {
+    static const std::uint64_t p1 = 11400714785074694791ULL;
+    static const std::uint64_t p2 = 14029467366897019727ULL;
+    static const std::uint64_t p3 = 1609587929392839161ULL;
+    static const std::uint64_t p4 = 9650029242287828579ULL;
+    static const std::uint64_t p5 = 2870177450012600261ULL;
+
+    auto round = [](std::uint64_t acc, std::uint64_t input) {
+        return rotl64(acc + input * p2, 31) * p1;
+    };
+
+    char const* p = data;
+    char const* const end = data + n;
+    std::uint64_t h;
+
+    if (n >= 32) {
+        std::uint64_t v1 = seed + p1 + p2;
+        std::uint64_t v2 = seed + p2;
+        std::uint64_t v3 = seed;
+        std::uint64_t v4 = seed - p1;
+        do {
+            v1 = round(v1, load64(p));
+            v2 = round(v2, load64(p + 8));
+            v3 = round(v3, load64(p + 16));
+            v4 = round(v4, load64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        for (std::uint64_t v : {v1, v2, v3, v4})
+            h = (h ^ round(0, v)) * p1 + p4;
+    }
+    else {
+        h = seed + p5;
+    }
+
+    h += n;
+    for (; end - p >= 8; p += 8)
+        h = rotl64(h ^ round(0, load64(p)), 27) * p1 + p4;
+    if (end - p >= 4) {
+        h = rotl64(h ^ (load32(p) * p1), 23) * p2 + p3;
+        p += 4;
+    }
+    for (; p != end; ++p)
+        h = rotl64(h ^ (static_cast<unsigned char>(*p) * p5), 11) * p1;
+
+    h ^= h >> 33;
+    h *= p2;
+    h ^= h >> 29;
+    h *= p3;
+    h ^= h >> 32;
+    return h;
+}
+
+// whether bytes are those of the snapshot id, kept in $MATCHA_SNAPSHOT_DIR
+// or else in ./snapshots; a snapshot is recorded from bytes when there is
+// none yet, or when $MATCHA_UPDATE_SNAPSHOTS is set
+MATCHA_INLINE bool snapshot_matches(std::string const& id, string_ref bytes);
+
+// the file holding the data of the snapshot id
+MATCHA_INLINE std::string snapshot_path(std::string const& id);
+
+// what a value is snapshotted as: texts as they are, other values as
+// they are printed, containers in full rather than within the print limits
+template<typename T>
+typename std::enable_if<std::is_convertible<T const&, string_ref>::value, string_ref>::type
+snapshot_bytes(T const& actual, writer&) {
+    return actual;
+}
+
+template<typename T>
+typename std::enable_if<!std::is_convertible<T const&, string_ref>::value, string_ref>::type
+snapshot_bytes(T const& actual, writer& o) {
+    pretty_print::unbounded whole;
+    o << actual;
+    return o.str();
+}
+
+} // namespace detail
+
+/*
+ * compares with a snapshot kept on disk under a name, recording it when
+ * there is none yet:
+ *
+ *   assertThat(render(page), matchesSnapshot("home-page"));
+ *
+ * A value is checked against the size and hash of its snapshot, and the
+ * snapshot itself is read only when they differ, to tell where. Values
+ * that aren't texts are snapshotted as they are printed, containers
+ * whatever pretty_print::limits() says.
+ */
+struct MatchesSnapshot_ {
+    static constexpr match_cost cost = cost_expensive;
+
+protected:
+    template<typename T>
+    bool matches(std::string const& id, T const& actual) const {
+        writer buffer;
+        return detail::snapshot_matches(id, detail::snapshot_bytes(actual, buffer));
+    }
+
+    void describe(writer& o, std::string const& id) const {
+        o << "matches the snapshot \"" << id << "\"";
+    }
+
+    template<typename T>
+    void describe_mismatch(writer& o, std::string const& id, T const& actual) const {
+        writer buffer;
+        string_ref const bytes = detail::snapshot_bytes(actual, buffer);
+        std::string const path = detail::snapshot_path(id);
+        o << bytes.size() << " bytes";
+        try {
+            detail::describe_text_difference(o, fileContents(path), bytes);
+        }
+        catch (std::runtime_error const&) {
+            o << ", and " << path << " can't be read";
+        }
+    }
+};
+
+using MatchesSnapshot = Matcher<MatchesSnapshot_,std::string>;
+
+inline MatchesSnapshot matchesSnapshot(std::string id) {
+    return MatchesSnapshot(std::move(id));
+}
+
+struct IsEqual {
+protected:
+    template<typename T>
+    constexpr bool matches(T const& expected, T const& actual,
+                 typename std::enable_if<
+                    is_equality_comparable<T>::value
+                    >::type* = 0) const
+    {
+        return expected == actual;
+    }
+
+    template<typename T>
+    bool matches(T const& expected, T const& actual,
+                 typename std::enable_if<
+                    !is_equality_comparable<T>::value
+                    && std::is_pod<T>::value
+                    >::type* = 0) const
+    {
+        return !std::memcmp(&expected, &actual, sizeof expected);
+    }
+
+    bool matches(string_ref expected, string_ref actual) const {
+        return expected == actual;
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value>::type
+    matches_batch(T const& expected, T const* data, std::size_t n, match_word* bits) const {
+        detail::batch_apply(data, n, detail::compare_pred<T, std::equal_to<T>>{expected}, bits);
+    }
+
+    // views compare equal to any contiguous sequence of the same elements
+    template<typename T, typename C>
+    bool matches(array_ref<T> expected, C const& actual,
+                 typename std::enable_if<
+                    std::is_convertible<C const&, array_ref<T>>::value
+                    && !std::is_same<C, array_ref<T>>::value
+                    >::type* = 0) const
+    {
+        return expected == array_ref<T>(actual);
+    }
+
+    // sequences tell where they first differ instead of being printed whole,
+    // e.g. [... 3, 4, 9, 6, 7, ...] with 9 at index 4 instead of 5
+    template<typename C1, typename C2>
+    typename std::enable_if<
+        detail::is_sequence<C1>::value && detail::is_sequence<C2>::value
+        >::type
+    describe_mismatch(writer& o, C1 const& expected, C2 const& actual) const {
+        static const std::size_t radius = 3;
+
+        auto e = std::begin(expected);
+        auto const e_end = std::end(expected);
+        auto a = std::begin(actual);
+        auto const a_end = std::end(actual);
+
+        std::size_t index = 0;
+        for (; e != e_end && a != a_end && *e == *a; ++e, ++a)
+            ++index;
+
+        if (e == e_end && a == a_end) {
+            o << actual;
+            return;
+        }
+
+        std::size_t const first = index > radius ? index - radius : 0;
+        o << pretty_print::window(actual, first, index - first + radius + 1) << " with ";
+
+        if (a != a_end)
+            o << *a;
+        else
+            o << "no item";
+        o << " at index " << index << " instead of ";
+        if (e != e_end)
+            o << *e;
+        else
+            o << "no item";
+
+        std::size_t const expected_size = index + std::distance(e, e_end);
+        std::size_t const actual_size = index + std::distance(a, a_end);
+        if (expected_size != actual_size)
+            o << ", and " << actual_size << (actual_size == 1 ? " item" : " items")
+              << " instead of " << expected_size;
+    }
+
+    // texts of which one is a file, which is too large to print
+    template<typename E, typename A>
+    typename std::enable_if<
+        (detail::is_file<E>::value || detail::is_file<A>::value)
+        && std::is_convertible<E const&, string_ref>::value && std::is_convertible<A const&, string_ref>::value
+        >::type
+    describe_mismatch(writer& o, E const& expected, A const& actual) const {
+        o << actual;
+        detail::describe_text_difference(o, expected, actual);
+    }
+
+    template<typename T>
+    void describe(writer& o, T const& expected) const {
+       o << expected;
+    }
+};
+
+template<>
+inline void IsEqual::describe(writer& o, std::string const& expected) const {
+   o << "\"" << expected << "\"";
+}
+
+constexpr auto equalTo = make_matcher<IsEqual>();
+
+// comparing strings is a scan, comparing other containers a walk
+template<typename T>
+struct matcher_cost<IsEqual, T> : std::integral_constant<unsigned,
+    std::is_scalar<T>::value ? cost_cheap :
+    detail::is_string<T>::value ? cost_medium :
+    pretty_print::is_container<T>::value ? cost_expensive : cost_medium>
+{ };
+
+namespace detail {
+
+// SFINAE type trait to detect whether an associative container maps keys to values
+
+template<typename C, typename = void>
+struct has_mapped_type : std::false_type
+{ };
+
+template<typename C>
+struct has_mapped_type<C,
+    typename std::enable_if<true, decltype((void)std::declval<typename C::mapped_type*>())>::type
+    > : std::true_type
+{ };
+
+template<typename C, typename T>
+bool container_contains(C const& cont, T const& item, std::false_type) {
+    return std::end(cont) != std::find(std::begin(cont), std::end(cont), item);
+}
+
+// sets, use the container's own lookup
+template<typename C, typename T>
+bool associative_contains(C const& cont, T const& item, std::false_type) {
+    return cont.find(item) != cont.end();
+}
+
+// maps, look the key up and compare the values under it (there may be
+// several in a multimap)
+template<typename C, typename T>
+bool associative_contains(C const& cont, T const& item, std::true_type) {
+    auto range = cont.equal_range(item.first);
+    return std::any_of(range.first, range.second,
+                       [&item](T const& val) { return val.second == item.second; });
+}
+
+template<typename C, typename T>
+bool container_contains(C const& cont, T const& item, std::true_type) {
+    return associative_contains(cont, item, has_mapped_type<C>());
+}
+
+template<typename C, typename T>
+bool container_has_key(C const& cont, T const& key, std::true_type) {
+    return cont.find(key) != cont.end();
+}
+
+template<typename C, typename T>
+bool container_has_key(C const& cont, T const& key, std::false_type) {
+    for (auto const& val : cont) {
+        if (val.first == key)
+            return true;
+    }
+    return false;
+}
+
+} // namespace detail
+
+namespace detail {
+
+// Boyer-Moore-Horspool from offset first: the text is compared at each
+// position from the needle's last byte, and the byte under it tells how far
+// the needle can move on; shifts are the needle size at most
+inline std::size_t horspool_find(string_ref text, string_ref needle, std::uint32_t const* shift, std::size_t first) {
+    std::size_t const m = needle.size();
+    unsigned char const last = needle[m - 1];
+    for (std::size_t i = first; i + m <= text.size(); ) {
+        unsigned char const c = text[i + m - 1];
+        if (c == last && !std::memcmp(text.data() + i, needle.data(), m - 1))
+            return i;
+        i += shift[c];
+    }
+    return string_ref::npos;
+}
+
+#if defined(MATCHA_SIMD_SSE2)
+// 16 positions at once are kept only if the bytes under both ends of the
+// needle match, which few do, and those are compared with memcmp; returns
+// the first position left to look at by a scalar search when not found
+inline std::size_t first_last_find(string_ref text, string_ref needle, std::size_t& rest) {
+    std::size_t const m = needle.size();
+    __m128i const first = _mm_set1_epi8(needle[0]);
+    __m128i const last = _mm_set1_epi8(needle[m - 1]);
+    std::size_t i = 0;
+    for (; i + m - 1 + 16 <= text.size(); i += 16) {
+        __m128i const head = _mm_loadu_si128(reinterpret_cast<__m128i const*>(text.data() + i));
+        __m128i const tail = _mm_loadu_si128(reinterpret_cast<__m128i const*>(text.data() + i + m - 1));
+        unsigned mask = unsigned(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last))));
+        while (mask) {
+            std::size_t const at = i + first_set_bit(mask);
+            if (!std::memcmp(text.data() + at + 1, needle.data() + 1, m - 2))
+                return at;
+            mask &= mask - 1;
+        }
+    }
+    rest = i;
+    return string_ref::npos;
+}
+#endif
+
+} // namespace detail
+
+/*
+ * the needle of contains() on strings, with its Horspool shift table built
+ * once when the matcher is. Where SSE2 is available needles are looked for
+ * 16 positions at a time instead, which is faster even for needles long
+ * enough to skip 64 bytes at a time, and the table only serves the tail.
+ */
+class substring {
+public:
+    explicit substring(std::string needle) : needle_(std::move(needle)) {
+        std::size_t const m = needle_.size();
+        std::uint32_t const none = std::uint32_t(std::max<std::size_t>(m, 1));
+        std::fill(std::begin(shift_), std::end(shift_), none);
+        for (std::size_t i = 0; i + 1 < m; ++i)
+            shift_[static_cast<unsigned char>(needle_[i])] = std::uint32_t(m - 1 - i);
+    }
+
+    std::string const& str() const {
+        return needle_;
+    }
+
+    operator string_ref() const {
+        return needle_;
+    }
+
+    // offset of the needle in text, or string_ref::npos
+    std::size_t find_in(string_ref text) const {
+        std::size_t const m = needle_.size();
+        if (m == 0)
+            return 0;
+        if (m > text.size())
+            return string_ref::npos;
+        if (m == 1) {
+            void const* at = std::memchr(text.data(), needle_[0], text.size());
+            return at ? std::size_t(static_cast<char const*>(at) - text.data()) : string_ref::npos;
+        }
+        std::size_t first = 0;
+#if defined(MATCHA_SIMD_SSE2)
+        std::size_t const at = detail::first_last_find(text, needle_, first);
+        if (at != string_ref::npos)
+            return at;
+#endif
+        return detail::horspool_find(text, needle_, shift_, first);
+    }
+
+    friend writer& operator<<(writer& o, substring const& s) {
+        return o << s.needle_;
+    }
+
+    friend std::ostream& operator<<(std::ostream& o, substring const& s) {
+        return o << s.needle_;
+    }
+
+private:
+    std::string needle_;
+    std::uint32_t shift_[256];
+};
+
+/*
+ * the needles of containsAnyOf() and containsAllOf(), built once when the
+ * matcher is. From automaton_min of them on they make an Aho-Corasick
+ * automaton that scans a text once for all, a byte per step; fewer are
+ * faster to look for one at a time, with SIMD 16 bytes per step. The bytes
+ * no needle has share a single column of the transition table, which keeps
+ * it small. When the needles begin with just a few different bytes, the
+ * automaton skips the others while out of any needle, which makes it pay
+ * off sooner.
+ */
+class needle_set {
+public:
+    typedef std::vector<std::string>::const_iterator const_iterator;
+
+#if defined(MATCHA_SIMD_SSE2)
+    static constexpr std::size_t automaton_min = 32;
+    static constexpr std::size_t skipping_automaton_min = 8;
+#else
+    static constexpr std::size_t automaton_min = 4;
+    static constexpr std::size_t skipping_automaton_min = 4;
+#endif
+    static constexpr std::size_t skip_max = 4;
+
+    template<typename InputIt>
+    needle_set(InputIt first, InputIt last) {
+        std::fill(std::begin(starts_), std::end(starts_), false);
+        std::size_t firsts = 0;
+        for (; first != last; ++first) {
+            needles_.push_back(std::string(string_ref(*first)));
+            std::string const& needle = needles_.back();
+            if (!needle.empty() && !starts_[static_cast<unsigned char>(needle[0])]) {
+                starts_[static_cast<unsigned char>(needle[0])] = true;
+                ++firsts;
+            }
+        }
+        skip_ = firsts <= skip_max;
+        if (needles_.size() >= (skip_ ? skipping_automaton_min : automaton_min))
+            build();
+        else
+            for (auto const& needle : needles_)
+                searchers_.push_back(substring(needle));
+    }
+
+    needle_set(std::initializer_list<string_ref> needles)
+        : needle_set(needles.begin(), needles.end())
+    { }
+
+    // calls found(index) for the needles text contains, some maybe more than
+    // once, until it returns true; returns whether it did
+    template<typename F>
+    bool scan(string_ref text, F&& found) const {
+        if (next_.empty()) {
+            for (std::size_t i = 0; i != searchers_.size(); ++i) {
+                if (searchers_[i].find_in(text) != string_ref::npos && found(i))
+                    return true;
+            }
+            return false;
+        }
+        if (report(0, found))
+            return true;
+        return skip_ ? run<true>(text, found) : run<false>(text, found);
+    }
+
+    std::size_t size() const { return needles_.size(); }
+    std::string const& operator[](std::size_t i) const { return needles_[i]; }
+
+    const_iterator begin() const { return needles_.begin(); }
+    const_iterator end() const { return needles_.end(); }
+
+private:
+    // flags the transitions to states where needles end
+    static constexpr std::uint32_t output = std::uint32_t(1) << 31;
+
+    template<bool Skip, typename F>
+    bool run(string_ref text, F& found) const {
+        std::uint32_t row = 0;
+        char const* p = text.begin();
+        char const* const end = text.end();
+        while (p != end) {
+            // out of any needle, the bytes no needle begins with are skipped
+            // without waiting on the table
+            if (Skip && row == 0) {
+                while (p != end && !starts_[static_cast<unsigned char>(*p)])
+                    ++p;
+                if (p == end)
+                    break;
+            }
+            std::uint32_t const to = next_[row + class_[static_cast<unsigned char>(*p++)]];
+            row = to & ~output;
+            if ((to & output) && report(row / width_, found))
+                return true;
+        }
+        return false;
+    }
+
+    template<typename F>
+    bool report(std::size_t state, F& found) const {
+        for (std::uint32_t i = outputs_begin_[state]; i != outputs_begin_[state + 1]; ++i) {
+            if (found(std::size_t(outputs_[i])))
+                return true;
+        }
+        return false;
+    }
+
+    void build() {
+        static const std::uint32_t none = std::uint32_t(-1);
+
+        std::fill(std::begin(class_), std::end(class_), std::uint16_t(0));
+        width_ = 1;
+        for (auto const& needle : needles_) {
+            for (char c : needle) {
+                std::uint16_t& k = class_[static_cast<unsigned char>(c)];
+                if (k == 0)
+                    k = std::uint16_t(width_++);
+            }
+        }
+
+        // the trie of the needles
+        std::vector<std::vector<std::uint32_t>> outputs(1);
+        next_.assign(width_, none);
+        for (std::size_t id = 0; id != needles_.size(); ++id) {
+            std::uint32_t state = 0;
+            for (char c : needles_[id]) {
+                std::size_t const edge = state * width_ + class_[static_cast<unsigned char>(c)];
+                if (next_[edge] == none) {
+                    next_[edge] = std::uint32_t(outputs.size());
+                    outputs.emplace_back();
+                    next_.resize(next_.size() + width_, none);
+                }
+                state = next_[edge];
+            }
+            outputs[state].push_back(std::uint32_t(id));
+        }
+
+        // breadth first, each state falls back on the longest suffix of
+        // its path in the trie, whose transitions and outputs it takes on
+        std::vector<std::uint32_t> fail(outputs.size(), 0);
+        std::vector<std::uint32_t> queue;
+        for (std::size_t k = 0; k != width_; ++k) {
+            std::uint32_t& to = next_[k];
+            if (to == none)
+                to = 0;
+            else
+                queue.push_back(to);
+        }
+        for (std::size_t head = 0; head != queue.size(); ++head) {
+            std::uint32_t const state = queue[head];
+            for (std::size_t k = 0; k != width_; ++k) {
+                std::uint32_t& to = next_[state * width_ + k];
+                std::uint32_t const fallback = next_[fail[state] * width_ + k];
+                if (to == none) {
+                    to = fallback;
+                    continue;
+                }
+                fail[to] = fallback;
+                outputs[to].insert(outputs[to].end(), outputs[fallback].begin(), outputs[fallback].end());
+                queue.push_back(to);
+            }
+        }
+
+        if (outputs.size() * width_ >= output)
+            throw std::length_error("matcha: too many needles");
+
+        // transitions give the row of the state they lead to
+        for (auto& to : next_)
+            to = std::uint32_t(to * width_) | (outputs[to].empty() ? 0 : output);
+
+        outputs_begin_.assign(1, 0);
+        for (auto const& out : outputs) {
+            outputs_.insert(outputs_.end(), out.begin(), out.end());
+            outputs_begin_.push_back(std::uint32_t(outputs_.size()));
+        }
+    }
+
+    std::vector<std::string> needles_;
+    std::vector<substring> searchers_;
+    std::uint16_t class_[256];
+    bool starts_[256];
+    bool skip_;
+    std::uint32_t width_;
+    std::vector<std::uint32_t> next_;
+    std::vector<std::uint32_t> outputs_begin_;
+    std::vector<std::uint32_t> outputs_;
+};
+
+struct IsContaining_ {
+protected:
+    template<typename T, typename It, typename S>
+    bool matches(T const& item, input_range<It, S> const& range) const {
+        return range.find(detail::equal_to_item<T>{item});
+    }
+
+    template<typename It, typename S, typename T, typename Policy>
+    bool matches(Matcher<Policy,T> const& itemMatcher, input_range<It, S> const& range) const {
+        return !range.find(detail::mismatching<Matcher<Policy,T>>{itemMatcher});
+    }
+
+    template<typename C, typename T,
+         typename std::enable_if<std::is_same<typename C::value_type,T>::value>::type* = nullptr>
+    bool matches(T const& item, C const& cont) const {
+        return detail::container_contains(cont, item, is_associative<C>());
+    }
+
+    template<typename T, size_t N>
+    bool matches(T const& item, T const (&array)[N]) const {
+        return std::end(array) != std::find(std::begin(array), std::end(array), item);
+    }
+
+    template<typename C = std::string, typename T = std::string>
+    bool matches(string_ref substr, string_ref actual) const {
+        return string_ref::npos != actual.find(substr);
+    }
+
+    bool matches(substring const& substr, string_ref actual) const {
+        return string_ref::npos != substr.find_in(actual);
+    }
+
+    // a container of strings, rather than a string, has the whole of one
+    template<typename C,
+         typename std::enable_if<std::is_same<typename C::value_type,std::string>::value>::type* = nullptr>
+    bool matches(substring const& item, C const& cont) const {
+        return detail::container_contains(cont, item.str(), is_associative<C>());
+    }
+
+    template<typename It, typename S>
+    bool matches(substring const& item, input_range<It, S> const& range) const {
+        return range.find(detail::equal_to_item<std::string>{item.str()});
+    }
+
+    // overload for checking whether container values match a predicate specified by a Matcher
+    template<typename C, typename T, typename Policy,
+         typename std::enable_if<::pretty_print::is_container<C>::value>::type* = nullptr>
+    bool matches(Matcher<Policy,T> const& itemMatcher, C const& cont) const {
+        return matchAll(cont, itemMatcher);
+    }
+
+    template<typename T>
+    void describe(writer& o, T const& expected) const {
+       o << "contains " << expected;
+    }
+
+    template<typename T, typename Policy>
+    void describe(writer& o, Matcher<Policy,T> const& expected) const {
+       o << "every item " << expected;
+    }
+};
+
+template<>
+inline void IsContaining_::describe(writer& o, std::string const& expected) const {
+   o << "contains " << "\"" << expected << "\"";
+}
+
+template<>
+inline void IsContaining_::describe(writer& o, substring const& expected) const {
+   o << "contains " << "\"" << expected << "\"";
+}
+
+template<class T>
+using IsContaining = Matcher<IsContaining_,T>;
+
+template<typename T>
+struct matcher_cost<IsContaining_, T> : std::integral_constant<unsigned,
+    detail::is_string<T>::value ? cost_medium : cost_expensive>
+{ };
+
+template<>
+struct matcher_cost<IsContaining_, substring> : std::integral_constant<unsigned, cost_medium>
+{ };
+
+template<typename T>
+constexpr IsContaining<T> contains(T const& value) {
+    return IsContaining<T>(value);
+}
+
+template<typename T, typename = typename std::enable_if<
+    !std::is_reference<T>::value && !std::is_const<T>::value>::type>
+constexpr IsContaining<T> contains(T&& value) {
+    return IsContaining<T>(static_cast<T&&>(value));
+}
+
+template<typename T, size_t N>
+constexpr IsContaining<T[N]> contains(T const (&value)[N]) {
+    return IsContaining<T[N]>(value);
+}
+
+// strings are searched for with a shift table built here, once
+inline IsContaining<substring> contains(std::string value) {
+    return IsContaining<substring>(substring(std::move(value)));
+}
+
+template<size_t N>
+IsContaining<substring> contains(char const (&value)[N]) {
+    return IsContaining<substring>(substring(std::string(value)));
+}
+
+template<class Key, class T>
+constexpr IsContaining<std::pair<const typename std::decay<Key>::type, typename std::decay<T>::type>>
+contains(Key&& key, T&& value) {
+    return IsContaining<std::pair<const typename std::decay<Key>::type, typename std::decay<T>::type>>(
+        std::pair<const typename std::decay<Key>::type, typename std::decay<T>::type>(
+            static_cast<Key&&>(key), static_cast<T&&>(value)));
+}
+
+template<typename T, typename Policy>
+constexpr IsContaining<Matcher<Policy,T>> everyItem(Matcher<Policy,T> const& itemMatcher) {
+    return IsContaining<Matcher<Policy,T>>(itemMatcher);
+}
+
+template<typename T, typename Policy>
+constexpr IsContaining<Matcher<Policy,T>> everyItem(Matcher<Policy,T>&& itemMatcher) {
+    return IsContaining<Matcher<Policy,T>>(static_cast<Matcher<Policy,T>&&>(itemMatcher));
+}
+
+namespace detail {
+
+inline void write_needles(writer& o, needle_set const& needles) {
+    o << "[";
+    for (std::size_t i = 0; i != needles.size(); ++i)
+        o << (i ? ", \"" : "\"") << needles[i] << "\"";
+    o << "]";
+}
+
+} // namespace detail
+
+struct IsContainingAnyOf_ {
+    static constexpr match_cost cost = cost_medium;
+
+protected:
+    bool matches(needle_set const& needles, string_ref actual) const {
+        return needles.scan(actual, [](std::size_t) { return true; });
+    }
+
+    void describe(writer& o, needle_set const& expected) const {
+       o << "contains any of ";
+       detail::write_needles(o, expected);
+    }
+};
+
+struct IsContainingAllOf_ {
+    static constexpr match_cost cost = cost_medium;
+
+protected:
+    bool matches(needle_set const& needles, string_ref actual) const {
+        return missing(needles, actual).empty();
+    }
+
+    void describe(writer& o, needle_set const& expected) const {
+       o << "contains all of ";
+       detail::write_needles(o, expected);
+    }
+
+    // e.g. "fatal: disk full", without ["error"]
+    void describe_mismatch(writer& o, needle_set const& expected, string_ref actual) const {
+        std::vector<bool> const lacking = missing(expected, actual);
+        o << "\"" << actual << "\", without [";
+        bool first = true;
+        for (std::size_t i = 0; i != lacking.size(); ++i) {
+            if (!lacking[i])
+                continue;
+            o << (first ? "\"" : ", \"") << expected[i] << "\"";
+            first = false;
+        }
+        o << "]";
+    }
+
+private:
+    // which needles the text lacks, or nothing if it has them all
+    static std::vector<bool> missing(needle_set const& needles, string_ref actual) {
+        std::vector<bool> lacking(needles.size(), true);
+        std::size_t left = needles.size();
+        needles.scan(actual, [&](std::size_t i) {
+            if (lacking[i]) {
+                lacking[i] = false;
+                --left;
+            }
+            return left == 0;
+        });
+        if (left == 0)
+            lacking.clear();
+        return lacking;
+    }
+};
+
+using IsContainingAnyOf = Matcher<IsContainingAnyOf_,needle_set>;
+using IsContainingAllOf = Matcher<IsContainingAllOf_,needle_set>;
+
+// whether a text contains at least one of the needles, looked for in one pass
+inline IsContainingAnyOf containsAnyOf(std::initializer_list<string_ref> needles) {
+    return IsContainingAnyOf(needle_set(needles));
+}
+
+template<typename C>
+IsContainingAnyOf containsAnyOf(C const& needles) {
+    return IsContainingAnyOf(needle_set(std::begin(needles), std::end(needles)));
+}
+
+// whether a text contains every one of the needles, looked for in one pass
+inline IsContainingAllOf containsAllOf(std::initializer_list<string_ref> needles) {
+    return IsContainingAllOf(needle_set(needles));
+}
+
+template<typename C>
+IsContainingAllOf containsAllOf(C const& needles) {
+    return IsContainingAllOf(needle_set(std::begin(needles), std::end(needles)));
+}
+
+/*
+ * everyItem(matcher, par) splits large random-access containers into chunks
+ * matched on a pool of threads, and stops all of them as soon as one finds
+ * an item that doesn't match. Matchers are const and side-effect free, so
+ * they can be shared by the threads.
+ */
+struct parallel_policy {
+    // containers with fewer items are matched on the calling thread
+    std::size_t min_items;
+
+    constexpr parallel_policy(std::size_t min = std::size_t(1) << 16) : min_items(min)
+    { }
+};
+
+constexpr parallel_policy par = parallel_policy();
+
+namespace detail {
+
+// the threads matching in parallel, the calling one included
+MATCHA_INLINE std::size_t parallel_threads();
+
+// calls task(i) for every i in [0, tasks) on the threads of the program's
+// pool, returning once all are done. Calls made from inside a task run
+// inline, so nested parallel matchers can't deadlock.
+MATCHA_INLINE void run_parallel(std::size_t tasks, std::function<void(std::size_t)> const& task);
+
+template<typename It>
+struct iterator_range {
+    It first;
+    It last;
+
+    It begin() const { return first; }
+    It end() const { return last; }
+};
+
+// items [lo, hi) of a container, as a view that keeps batch matching
+// available for contiguous ones
+template<typename C>
+array_ref<typename range_value<C>::type>
+slice(C const& cont, std::size_t lo, std::size_t hi, std::true_type) {
+    array_ref<typename range_value<C>::type> all(cont);
+    return array_ref<typename range_value<C>::type>(all.data() + lo, hi - lo);
+}
+
+template<typename C>
+iterator_range<decltype(std::begin(std::declval<C const&>()))>
+slice(C const& cont, std::size_t lo, std::size_t hi, std::false_type) {
+    auto first = std::begin(cont);
+    iterator_range<decltype(first)> range = { first + lo, first + hi };
+    return range;
+}
+
+template<typename C, typename M>
+bool parallel_match_all(C const& cont, M const& matcher, parallel_policy const& policy, std::true_type) {
+    std::size_t const size = std::distance(std::begin(cont), std::end(cont));
+    std::size_t const threads = parallel_threads();
+    if (size < policy.min_items || threads < 2)
+        return matchAll(cont, matcher);
+
+    // several chunks per thread balance uneven matchers; chunks are matched
+    // in blocks so that a mismatch elsewhere is noticed quickly
+    static const std::size_t block = batch_elements;
+    std::size_t const chunks = std::min(threads * 4, (size + block - 1) / block);
+    std::atomic<bool> mismatch(false);
+    typedef std::integral_constant<bool,
+        std::is_convertible<C const&, array_ref<typename range_value<C>::type>>::value> contiguous;
+
+    run_parallel(chunks, [&](std::size_t chunk) {
+        std::size_t const last = size * (chunk + 1) / chunks;
+        for (std::size_t lo = size * chunk / chunks; lo < last; lo += block) {
+            if (mismatch.load(std::memory_order_relaxed))
+                return;
+            if (!matchAll(slice(cont, lo, std::min(lo + block, last), contiguous()), matcher)) {
+                mismatch.store(true, std::memory_order_relaxed);
+                return;
+            }
+        }
+    });
+    return !mismatch.load();
+}
+
+template<typename C, typename M>
+bool parallel_match_all(C const& cont, M const& matcher, parallel_policy const&, std::false_type) {
+    return matchAll(cont, matcher);
+}
+
+} // namespace detail
+
+struct IsEveryItemInParallel_ {
+    static constexpr match_cost cost = cost_expensive;
+
+protected:
+    template<typename C, typename M>
+    bool matches(std::pair<M, parallel_policy> const& expected, C const& cont) const {
+        typedef typename std::iterator_traits<decltype(std::begin(cont))>::iterator_category category;
+        return detail::parallel_match_all(cont, expected.first, expected.second,
+                                          std::is_base_of<std::random_access_iterator_tag, category>());
+    }
+
+    template<typename M>
+    void describe(writer& o, std::pair<M, parallel_policy> const& expected) const {
+       o << "every item " << expected.first;
+    }
+};
+
+template<typename M>
+using IsEveryItemInParallel = Matcher<IsEveryItemInParallel_, std::pair<M, parallel_policy>>;
+
+template<typename T, typename Policy>
+IsEveryItemInParallel<Matcher<Policy,T>> everyItem(Matcher<Policy,T> const& itemMatcher, parallel_policy const& policy) {
+    return IsEveryItemInParallel<Matcher<Policy,T>>(std::make_pair(itemMatcher, policy));
+}
+
+template<typename T, typename Policy>
+IsEveryItemInParallel<Matcher<Policy,T>> everyItem(Matcher<Policy,T>&& itemMatcher, parallel_policy const& policy) {
+    return IsEveryItemInParallel<Matcher<Policy,T>>(std::make_pair(std::move(itemMatcher), policy));
+}
+
+struct IsContainingKey {
+    static constexpr match_cost cost = cost_medium;
+
+protected:
+    template<typename C, typename T,
+         typename std::enable_if<std::is_same<typename C::key_type,T>::value>::type* = nullptr>
+    bool matches(T const& key, C const& cont) const {
+        return detail::container_has_key(cont, key, is_associative<C>());
+    }
+
+    template<typename T>
+    void describe(writer& o, T const& expected) const {
+       o << "has key " << expected;
+    }
+};
+
+constexpr auto hasKey = make_matcher<IsContainingKey>();
+
+namespace detail {
+
+enum class lookup_kind { linear, hashed, sorted };
+
+template<typename T>
+struct lookup_kind_of : std::integral_constant<lookup_kind,
+    is_hashable<T>::value && is_equality_comparable<T>::value ? lookup_kind::hashed
+    : is_lessthan_comparable<T>::value ? lookup_kind::sorted
+    : lookup_kind::linear>
+{ };
+
+// an index of values, left empty unless indexed
+template<typename T, lookup_kind = lookup_kind_of<T>::value>
+class lookup_index {
+public:
+    lookup_index(std::vector<T> const&, bool) { }
+    bool contains(std::vector<T> const& values, T const& value) const {
+        return std::end(values) != std::find(std::begin(values), std::end(values), value);
+    }
+};
+
+template<typename T>
+class lookup_index<T, lookup_kind::hashed> {
+public:
+    lookup_index(std::vector<T> const& values, bool indexed) {
+        if (indexed)
+            index_.insert(values.begin(), values.end());
+    }
+    bool contains(std::vector<T> const&, T const& value) const {
+        return index_.count(value) != 0;
+    }
+private:
+    std::unordered_set<T> index_;
+};
+
+template<typename T>
+class lookup_index<T, lookup_kind::sorted> {
+public:
+    lookup_index(std::vector<T> const& values, bool indexed) {
+        if (!indexed)
+            return;
+        index_ = values;
+        std::sort(index_.begin(), index_.end());
+    }
+    bool contains(std::vector<T> const&, T const& value) const {
+        return std::binary_search(index_.begin(), index_.end(), value);
+    }
+private:
+    std::vector<T> index_;
+};
+
+} // namespace detail
+
+/*
+ * the candidate values of in() and oneOf(), indexed once when the matcher is
+ * built: hashed if std::hash supports T, sorted if T is only LessThanComparable.
+ * A handful of values is just scanned, which beats hashing or bisecting them.
+ */
+template<typename T>
+class lookup_set {
+public:
+    typedef T value_type;
+    typedef typename std::vector<T>::const_iterator const_iterator;
+
+    static constexpr std::size_t linear_max = 8;
+
+    template<typename InputIt>
+    lookup_set(InputIt first, InputIt last)
+        : values_(first, last),
+          index_(values_, values_.size() > linear_max)
+    { }
+
+    lookup_set(std::initializer_list<T> values)
+        : lookup_set(values.begin(), values.end())
+    { }
+
+    explicit lookup_set(std::vector<T>&& values)
+        : values_(std::move(values)),
+          index_(values_, values_.size() > linear_max)
+    { }
+
+    bool contains(T const& value) const {
+        if (values_.size() > linear_max)
+            return index_.contains(values_, value);
+        return std::end(values_) != std::find(std::begin(values_), std::end(values_), value);
+    }
+
+    std::size_t size() const { return values_.size(); }
+
+    // iterates the values in the order they were given, for describe()
+    const_iterator begin() const { return values_.begin(); }
+    const_iterator end() const { return values_.end(); }
+
+private:
+    std::vector<T> values_;
+    detail::lookup_index<T> index_;
+};
+
+struct IsIn_ {
+    static constexpr match_cost cost = cost_medium;
+
+protected:
+    template<typename T>
+    bool matches(lookup_set<T> const& set, T const& item) const {
+        return set.contains(item);
+    }
+
+    template<typename C, typename T,
+         typename std::enable_if<std::is_same<typename C::value_type,T>::value>::type* = nullptr>
+    bool matches(C const& cont, T const& item) const {
+        return std::end(cont) != std::find(std::begin(cont), std::end(cont), item);
+    }
+
+    template<typename T, size_t N>
+    bool matches(T const (&array)[N], T const& item) const {
+        return std::end(array) != std::find(std::begin(array), std::end(array), item);
+    }
+
+    template<typename T, size_t N>
+    constexpr bool matches(std::array<T,N> const& array, T const& item) const {
+        return contains(array, item, 0, N);
+    }
+
+    template<typename C>
+    void describe(writer& o, C const& expected) const {
+       o << "one of " << expected;
+    }
+
+private:
+    // halves the range, so that constant evaluation recurses log N deep
+    template<typename T, size_t N>
+    static constexpr bool contains(std::array<T,N> const& array, T const& item, size_t first, size_t last) {
+        return last - first == 0 ? false
+             : last - first == 1 ? array[first] == item
+             : contains(array, item, first, first + (last - first) / 2)
+               || contains(array, item, first + (last - first) / 2, last);
+    }
+};
+
+template<typename C>
+using IsIn = Matcher<IsIn_,lookup_set<typename detail::range_value<C>::type>>;
+
+template<typename C>
+IsIn<C> in(C const& cont) {
+    return IsIn<C>(lookup_set<typename detail::range_value<C>::type>(std::begin(cont), std::end(cont)));
+}
+
+// a vector given away is indexed in place
+template<typename T>
+IsIn<std::vector<T>> in(std::vector<T>&& values) {
+    return IsIn<std::vector<T>>(lookup_set<T>(std::move(values)));
+}
+
+// std::array is searched as is, so that the matcher is usable in constant
+// expressions
+template<typename T, size_t N>
+constexpr Matcher<IsIn_, std::array<T,N>> in(std::array<T,N> const& array) {
+    return Matcher<IsIn_, std::array<T,N>>(array);
+}
+
+template<typename T, typename... Args>
+IsIn<std::vector<T>> oneOf(T const& first, Args const& ... args) {
+    return IsIn<std::vector<T>>(lookup_set<T>{first, args...});
+}
+
+template<size_t M, size_t... N>
+IsIn<std::vector<std::string>> oneOf(const char (&first)[M], const char (&...args)[N]) {
+    return IsIn<std::vector<std::string>>(lookup_set<std::string>{first, args...});
+}
+
+namespace detail {
+
+// what an actual container has too few and too many of, compared to the
+// expected items
+template<typename T>
+struct multiset_difference {
+    std::vector<T> missing;
+    std::vector<T> unexpected;
+    std::size_t size = 0;
+};
+
+// equality alone: each item is looked for among those not found yet, which
+// is quadratic
+template<typename T, lookup_kind = lookup_kind_of<T>::value>
+class multiset_index {
+public:
+    multiset_index(std::vector<T> const&) { }
+
+    template<typename C>
+    bool compare(std::vector<T> const& values, C const& actual, multiset_difference<T>* diff) const {
+        std::vector<bool> found(values.size());
+        bool same = true;
+        std::size_t size = 0;
+        for (auto const& item : actual) {
+            ++size;
+            std::size_t i = 0;
+            while (i != values.size() && (found[i] || !(values[i] == item)))
+                ++i;
+            if (i != values.size()) {
+                found[i] = true;
+                continue;
+            }
+            same = false;
+            if (!diff)
+                return false;
+            diff->unexpected.push_back(item);
+        }
+        for (std::size_t i = 0; i != values.size(); ++i) {
+            if (found[i])
+                continue;
+            same = false;
+            if (!diff)
+                return false;
+            diff->missing.push_back(values[i]);
+        }
+        if (diff)
+            diff->size = size;
+        return same;
+    }
+};
+
+// hashed: each distinct item gets a slot with its expected count, and a
+// comparison counts the actual items down from a copy of the counts
+template<typename T>
+class multiset_index<T, lookup_kind::hashed> {
+public:
+    multiset_index(std::vector<T> const& values) {
+        slots_.reserve(values.size());
+        for (std::size_t i = 0; i != values.size(); ++i) {
+            auto slot = slots_.emplace(values[i], counts_.size());
+            if (slot.second) {
+                counts_.push_back(0);
+                firsts_.push_back(i);
+            }
+            ++counts_[slot.first->second];
+        }
+    }
+
+    template<typename C>
+    bool compare(std::vector<T> const& values, C const& actual, multiset_difference<T>* diff) const {
+        std::vector<std::size_t> left(counts_);
+        bool same = true;
+        std::size_t size = 0;
+        for (auto const& item : actual) {
+            ++size;
+            auto slot = slots_.find(item);
+            if (slot != slots_.end() && left[slot->second] != 0) {
+                --left[slot->second];
+                continue;
+            }
+            same = false;
+            if (!diff)
+                return false;
+            diff->unexpected.push_back(item);
+        }
+        for (std::size_t i = 0; i != left.size(); ++i) {
+            if (left[i] == 0)
+                continue;
+            same = false;
+            if (!diff)
+                return false;
+            diff->missing.insert(diff->missing.end(), left[i], values[firsts_[i]]);
+        }
+        if (diff)
+            diff->size = size;
+        return same;
+    }
+
+private:
+    std::unordered_map<T, std::size_t> slots_;
+    std::vector<std::size_t> counts_;
+    std::vector<std::size_t> firsts_;
+};
+
+// sorted: the actual items are sorted too, and both are walked in step
+template<typename T>
+class multiset_index<T, lookup_kind::sorted> {
+public:
+    multiset_index(std::vector<T> const& values) : sorted_(values) {
+        std::sort(sorted_.begin(), sorted_.end());
+    }
+
+    template<typename C>
+    bool compare(std::vector<T> const&, C const& actual, multiset_difference<T>* diff) const {
+        std::vector<T> items(std::begin(actual), std::end(actual));
+        if (!diff && items.size() != sorted_.size())
+            return false;
+        std::sort(items.begin(), items.end());
+
+        bool same = true;
+        auto e = sorted_.begin();
+        auto a = items.begin();
+        while (e != sorted_.end() || a != items.end()) {
+            if (a == items.end() || (e != sorted_.end() && *e < *a)) {
+                if (!diff)
+                    return false;
+                diff->missing.push_back(*e++);
+            }
+            else if (e == sorted_.end() || *a < *e) {
+                if (!diff)
+                    return false;
+                diff->unexpected.push_back(*a++);
+            }
+            else {
+                ++e;
+                ++a;
+                continue;
+            }
+            same = false;
+        }
+        if (diff)
+            diff->size = items.size();
+        return same;
+    }
+
+private:
+    std::vector<T> sorted_;
+};
+
+} // namespace detail
+
+/*
+ * the expected items of containsInAnyOrder() and sameElementsAs(), counted
+ * once when the matcher is built: in a hash table if std::hash supports T,
+ * sorted if T is only LessThanComparable, so that a container of n items is
+ * checked in O(n) or O(n log n).
+ */
+template<typename T>
+class item_multiset {
+public:
+    typedef T value_type;
+    typedef typename std::vector<T>::const_iterator const_iterator;
+
+    template<typename InputIt>
+    item_multiset(InputIt first, InputIt last)
+        : values_(first, last), index_(values_)
+    { }
+
+    item_multiset(std::initializer_list<T> values)
+        : item_multiset(values.begin(), values.end())
+    { }
+
+    explicit item_multiset(std::vector<T>&& values)
+        : values_(std::move(values)), index_(values_)
+    { }
+
+    // whether actual has the same items as many times each, in any order;
+    // the difference is only filled in if given
+    template<typename C>
+    bool compare(C const& actual, detail::multiset_difference<T>* diff = nullptr) const {
+        return index_.compare(values_, actual, diff);
+    }
+
+    std::size_t size() const { return values_.size(); }
+
+    // iterates the items in the order they were given, for describe()
+    const_iterator begin() const { return values_.begin(); }
+    const_iterator end() const { return values_.end(); }
+
+private:
+    std::vector<T> values_;
+    detail::multiset_index<T> index_;
+};
+
+struct IsContainingInAnyOrder_ {
+    static constexpr match_cost cost = cost_expensive;
+
+protected:
+    template<typename T, typename C,
+         typename std::enable_if<std::is_same<typename detail::range_value<C>::type,T>::value>::type* = nullptr>
+    bool matches(item_multiset<T> const& expected, C const& actual) const {
+        return expected.compare(actual);
+    }
+
+    template<typename T>
+    void describe(writer& o, item_multiset<T> const& expected) const {
+       o << "contains in any order " << expected;
+    }
+
+    // e.g. 5 items, missing [3] and unexpected [4, 4]
+    template<typename T, typename C>
+    void describe_mismatch(writer& o, item_multiset<T> const& expected, C const& actual) const {
+        detail::multiset_difference<T> diff;
+        expected.compare(actual, &diff);
+        o << diff.size << (diff.size == 1 ? " item" : " items");
+        if (!diff.missing.empty())
+            o << ", missing " << diff.missing;
+        if (!diff.unexpected.empty())
+            o << (diff.missing.empty() ? ", " : " and ") << "unexpected " << diff.unexpected;
+    }
+};
+
+template<typename T>
+using IsContainingInAnyOrder = Matcher<IsContainingInAnyOrder_,item_multiset<T>>;
+
+template<typename T, typename... Args>
+IsContainingInAnyOrder<T> containsInAnyOrder(T const& first, Args const& ... args) {
+    return IsContainingInAnyOrder<T>(item_multiset<T>{first, args...});
+}
+
+template<size_t M, size_t... N>
+IsContainingInAnyOrder<std::string> containsInAnyOrder(const char (&first)[M], const char (&...args)[N]) {
+    return IsContainingInAnyOrder<std::string>(item_multiset<std::string>{first, args...});
+}
+
+template<typename C>
+IsContainingInAnyOrder<typename detail::range_value<C>::type> sameElementsAs(C const& cont) {
+    typedef typename detail::range_value<C>::type T;
+    return IsContainingInAnyOrder<T>(item_multiset<T>(std::begin(cont), std::end(cont)));
+}
+
+// a vector given away is counted in place
+template<typename T>
+IsContainingInAnyOrder<T> sameElementsAs(std::vector<T>&& values) {
+    return IsContainingInAnyOrder<T>(item_multiset<T>(std::move(values)));
+}
+
+struct IsEmpty_ {
+    static constexpr match_cost cost = cost_cheap;
+
+protected:
+    template<typename C>
+    bool matches(C const& actual) const {
+        static_assert(pretty_print::is_container<C>::value, "empty matcher is for std containers");
+        return actual.empty();
+    }
+
+    template<typename It, typename S>
+    bool matches(input_range<It, S> const& range) const {
+        return !range.find(detail::any_item());
+    }
+
+    void describe(writer& o) const {
+        o << "an empty container";
+    }
+};
+
+using IsEmpty = Matcher<IsEmpty_>;
+
+constexpr IsEmpty empty() {
+    return IsEmpty();
+}
+
+struct HasSize_ {
+    static constexpr match_cost cost = cost_cheap;
+
+protected:
+    template<typename C>
+    bool matches(std::size_t size, C const& actual) const {
+        static_assert(pretty_print::is_container<C>::value, "hasSize matcher is for std containers");
+        return std::size_t(std::distance(std::begin(actual), std::end(actual))) == size;
+    }
+
+    // reads one item past size at most
+    template<typename It, typename S>
+    bool matches(std::size_t size, input_range<It, S> const& range) const {
+        detail::past_count past = { size, 0 };
+        return !range.find(past) && past.seen == size;
+    }
+
+    void describe(writer& o, std::size_t size) const {
+        o << "a container with size " << size;
+    }
+};
+
+using HasSize = Matcher<HasSize_, std::size_t>;
+
+constexpr HasSize hasSize(std::size_t size) {
+    return HasSize(size);
+}
+
+namespace detail {
+
+// holds from the first item less than the one before it
+template<typename T>
+struct descending {
+    std::unique_ptr<T> last;
+
+    bool operator()(T const& item) {
+        if (last && item < *last)
+            return true;
+        if (last)
+            *last = item;
+        else
+            last.reset(new T(item));
+        return false;
+    }
+};
+
+} // namespace detail
+
+// items in ascending order, equal ones side by side
+struct IsSorted_ {
+    static constexpr match_cost cost = cost_expensive;
+
+protected:
+    template<typename C>
+    bool matches(C const& actual) const {
+        static_assert(pretty_print::is_container<C>::value, "isSorted matcher is for std containers");
+        return std::is_sorted(std::begin(actual), std::end(actual));
+    }
+
+    template<typename It, typename S>
+    bool matches(input_range<It, S> const& range) const {
+        return !range.find(detail::descending<typename input_range<It, S>::item_type>());
+    }
+
+    void describe(writer& o) const {
+        o << "sorted in ascending order";
+    }
+
+    template<typename C>
+    typename std::enable_if<pretty_print::is_container<C>::value>::type
+    describe_mismatch(writer& o, C const& actual) const {
+        // walked with the item before at hand, as forward iterators can't step back
+        auto const last = std::end(actual);
+        auto before = std::begin(actual);
+        auto out = before;
+        std::size_t index = 0;
+        if (out != last)
+            for (++out, ++index; out != last && !(*out < *before); before = out, ++out, ++index)
+                ;
+        if (out == last) {
+            o << actual;
+            return;
+        }
+        std::size_t const from = index > 3 ? index - 3 : 0;
+        o << pretty_print::window(actual, from, index - from + 4) << " with " << *out
+          << " at index " << index << " after " << *before;
+    }
+};
+
+using IsSorted = Matcher<IsSorted_>;
+
+constexpr IsSorted isSorted() {
+    return IsSorted();
+}
+
+struct IsEmptyString_ {
+    static constexpr match_cost cost = cost_cheap;
+
+protected:
+    bool matches(string_ref actual) const {
+        return actual.empty();
+    }
+
+    void describe(writer& o) const {
+        o << "an empty string";
+    }
+};
+
+using IsEmptyString = Matcher<IsEmptyString_>;
+
+constexpr IsEmptyString emptyString() {
+    return IsEmptyString();
+}
+
+struct IsEqualIgnoringCase_ {
+    static constexpr match_cost cost = cost_medium;
+
+protected:
+    bool matches(string_ref expected, string_ref actual) const {
+        return expected.size() == actual.size()
+            && detail::ci_mismatch(expected.data(), actual.data(), actual.size()) == actual.size();
+    }
+
+    void describe(writer& o, std::string const& expected) const {
+       o << "Equal to " << "\"" << expected << "\"" << " ignoring case";
+    }
+};
+
+using IsEqualIgnoringCase = Matcher<IsEqualIgnoringCase_,std::string>;
+
+inline IsEqualIgnoringCase equalToIgnoringCase(string_ref val) {
+    return IsEqualIgnoringCase(val.str());
+}
+
+struct IsEqualIgnoringWhiteSpace_ {
+    static constexpr match_cost cost = cost_medium;
+
+protected:
+    bool matches(string_ref expected, string_ref actual) const {
+        return detail::equal_ignoring_space(expected.data(), expected.size(),
+                                            actual.data(), actual.size());
+    }
+
+    void describe(writer& o, std::string const& expected) const {
+       o << "Equal to " << "\"" << expected << "\"" << " ignoring white space";
+    }
+};
+
+using IsEqualIgnoringWhiteSpace = Matcher<IsEqualIgnoringWhiteSpace_,std::string>;
+
+inline IsEqualIgnoringWhiteSpace equalToIgnoringWhiteSpace(string_ref val) {
+    return IsEqualIgnoringWhiteSpace(val.str());
+}
+
+struct StringStartsWith_ {
+    static constexpr match_cost cost = cost_medium;
+
+protected:
+    bool matches(string_ref substr, string_ref actual) const {
+        return actual.starts_with(substr);
+    }
+
+    void describe(writer& o, std::string const& expected) const {
+       o << "starts with " << "\"" << expected << "\"";
+    }
+};
+
+using StringStartsWith = Matcher<StringStartsWith_,std::string>;
+
+inline StringStartsWith startsWith(string_ref val) {
+    return StringStartsWith(val.str());
+}
+
+struct StringEndsWith_ {
+    static constexpr match_cost cost = cost_medium;
+
+protected:
+    bool matches(string_ref substr, string_ref actual) const {
+        return actual.ends_with(substr);
+    }
+
+    void describe(writer& o, std::string const& expected) const {
+       o << "ends with " << "\"" << expected << "\"";
+    }
+};
+
+using StringEndsWith = Matcher<StringEndsWith_,std::string>;
+
+inline StringEndsWith endsWith(string_ref val) {
+    return StringEndsWith(val.str());
+}
+
+namespace detail {
+
+typedef int expand[];
+
+// the operands anyOf and allOf are composed of, with those that are
+// themselves anyOf or allOf respectively spliced in; get<J> is the J-th of
+// those a matcher brings
+
+template<typename Policy, typename M>
+struct operands {
+    typedef std::tuple<M> type;
+    static const bool spliced = false;
+    static const std::size_t size = 1;
+
+    template<std::size_t J, typename A>
+    static constexpr A&& get(A&& matcher) {
+        return std::forward<A>(matcher);
+    }
+};
+
+template<typename Policy, typename... Tp>
+struct operands<Policy, Matcher<Policy, std::tuple<Tp...>>> {
+    typedef std::tuple<Tp...> type;
+    static const bool spliced = true;
+    static const std::size_t size = sizeof...(Tp);
+
+    template<std::size_t J>
+    static constexpr typename std::tuple_element<J, type>::type const&
+    get(Matcher<Policy, type> const& matcher) {
+        return std::get<J>(matcher.expected());
+    }
+
+    // expected() && can't be constexpr in C++11, so a temporary's operands
+    // are moved out through the const one
+    template<std::size_t J>
+    static constexpr typename std::tuple_element<J, type>::type&&
+    get(Matcher<Policy, type>&& matcher) {
+        return std::get<J>(static_cast<type&&>(const_cast<type&>(matcher.expected())));
+    }
+};
+
+template<typename Policy, typename... Args>
+struct any_spliced : std::false_type
+{ };
+
+template<typename Policy, typename First, typename... Rest>
+struct any_spliced<Policy, First, Rest...> : std::integral_constant<bool,
+    operands<Policy, First>::spliced || any_spliced<Policy, Rest...>::value>
+{ };
+
+constexpr std::size_t splice_size() {
+    return 0;
+}
+
+template<typename... Rest>
+constexpr std::size_t splice_size(std::size_t first, Rest... rest) {
+    return first + splice_size(rest...);
+}
+
+// which argument the spliced operand p comes from, among arguments
+// bringing size operands each
+constexpr std::size_t splice_source(std::size_t, std::size_t) {
+    return 0;
+}
+
+template<typename... Rest>
+constexpr std::size_t splice_source(std::size_t p, std::size_t k, std::size_t size, Rest... rest) {
+    return p < size ? k : splice_source(p - size, k + 1, rest...);
+}
+
+// and which of the operands of that argument it is
+constexpr std::size_t splice_offset(std::size_t p) {
+    return p;
+}
+
+template<typename... Rest>
+constexpr std::size_t splice_offset(std::size_t p, std::size_t size, Rest... rest) {
+    return p < size ? p : splice_offset(p - size, rest...);
+}
+
+// the spliced operands, each taken from its argument by index rather than
+// by std::tuple_cat, which is costly to compile and not constexpr in C++11
+template<typename Policy, typename Positions, typename... Args>
+struct splice;
+
+template<typename Policy, std::size_t... P, typename... Args>
+struct splice<Policy, index_sequence<P...>, Args...> {
+    template<std::size_t Q>
+    using source = typename std::tuple_element<splice_source(Q, 0, operands<Policy, Args>::size...),
+                                               std::tuple<Args...>>::type;
+
+    typedef std::tuple<typename std::tuple_element<splice_offset(P, operands<Policy, Args>::size...),
+                                                   typename operands<Policy, source<P>>::type>::type...> type;
+
+    // args, a tuple of references to the arguments
+    template<typename Refs>
+    static constexpr type of(Refs&& args) {
+        return type(operands<Policy, source<P>>::template get<splice_offset(P, operands<Policy, Args>::size...)>(
+            std::get<splice_source(P, 0, operands<Policy, Args>::size...)>(std::move(args)))...);
+    }
+};
+
+// splicing is only done when there is something to splice
+template<typename Policy, bool = false, typename... Args>
+struct composition_ {
+    typedef std::tuple<Args...> type;
+
+    template<typename... A>
+    static constexpr Matcher<Policy, type> of(A&&... args) {
+        return Matcher<Policy, type>(type(std::forward<A>(args)...));
+    }
+};
+
+template<typename Policy, typename... Args>
+struct composition_<Policy, true, Args...> {
+    typedef splice<Policy, make_index_sequence<splice_size(operands<Policy, Args>::size...)>, Args...> spliced;
+    typedef typename spliced::type type;
+
+    template<typename... A>
+    static constexpr Matcher<Policy, type> of(A&&... args) {
+        return Matcher<Policy, type>(spliced::of(std::tuple<A&&...>(std::forward<A>(args)...)));
+    }
+};
+
+template<typename Policy, typename... Args>
+struct composition : composition_<Policy, any_spliced<Policy, Args...>::value, Args...>
+{ };
+
+// the batches of all but the first operand, combined with op into bits,
+// chunk by chunk
+template<typename M, typename T, typename Op>
+void combine_batch(M const& matcher, T const* data, std::size_t n, match_word* bits, Op op) {
+    match_word more[batch_elements / match_word_bits];
+    for (std::size_t i = 0; i < n; i += batch_elements) {
+        std::size_t const len = std::min(batch_elements, n - i);
+        matcher.matches_batch(data + i, len, more);
+        for (std::size_t w = 0; w * match_word_bits < len; ++w)
+            bits[i / match_word_bits + w] = op(bits[i / match_word_bits + w], more[w]);
+    }
+}
+
+template<typename T, typename Op, typename... Tp, std::size_t... I>
+void combine_batches(std::tuple<Tp...> const& t, T const* data, std::size_t n, match_word* bits, Op op,
+                     index_sequence<I...>) {
+    std::get<0>(t).matches_batch(data, n, bits);
+    (void)expand{0, (I == 0 ? 0 : (combine_batch(std::get<I>(t), data, n, bits, op), 0))...};
+}
+
+#if __cplusplus < 201402L
+// a C++11 constant expression can neither loop nor expand a pack into
+// statements, so the operands of anyOf and allOf are tried by a chain of
+// steps, one per operand in order of cost: unlike a recursion peeling the
+// indices off one by one, each step is named by its position only
+template<typename Tuple, typename A>
+struct operand_chain;
+
+template<typename A, typename... Tp>
+struct operand_chain<std::tuple<Tp...>, A> {
+    template<typename Order>
+    struct indices;
+
+    template<std::size_t... I>
+    struct indices<index_sequence<I...>> {
+        static constexpr std::size_t order[sizeof...(I)] = { I... };
+    };
+
+    typedef indices<by_cost<Tp...>> by_cost_order;
+
+    // whether the K-th operand in order, or one after it, gives settling
+    template<std::size_t K>
+    static constexpr typename std::enable_if<K == sizeof...(Tp), bool>::type
+    settled(std::tuple<Tp...> const&, A const&, bool) {
+        return false;
+    }
+
+    template<std::size_t K>
+    static constexpr typename std::enable_if<K < sizeof...(Tp), bool>::type
+    settled(std::tuple<Tp...> const& t, A const& actual, bool settling) {
+        return std::get<by_cost_order::order[K]>(t).matches(actual) == settling
+            || settled<K + 1>(t, actual, settling);
+    }
+};
+
+template<typename A, typename... Tp>
+template<std::size_t... I>
+constexpr std::size_t operand_chain<std::tuple<Tp...>, A>::indices<index_sequence<I...>>::order[sizeof...(I)];
+#endif
+
+
+template<typename... Tp, std::size_t... I>
+void print_operands(writer& o, std::tuple<Tp...> const& t, char const* separator, index_sequence<I...>) {
+    (void)expand{0, (o << (I == 0 ? "" : separator) << std::get<I>(t), 0)...};
+    o << ".";
+}
+
+} // namespace detail
+
+/*
+ * anyOf and allOf expand their operands in one go, instead of recursing over
+ * them, and nest flat: anyOf(anyOf(a, b), c) is anyOf(a, b, c). A loop can't
+ * be a C++11 constant expression, so before C++14 they go through a chain
+ * of steps, one per operand, to stay constexpr.
+ */
+struct AnyOf_ {
+protected:
+    template<class ActualType, typename... Tp>
+    constexpr bool matches(std::tuple<Tp...> const& t, ActualType const& actual) const {
+        static_assert(!detail::single_pass<ActualType>::value,
+                      "anyOf would match a single-pass range once per operand");
+        return matches(t, actual, detail::by_cost<Tp...>());
+    }
+
+    template<typename T, typename... Tp>
+    typename std::enable_if<detail::all_have_batch<T, Tp...>::value>::type
+    matches_batch(std::tuple<Tp...> const& t, T const* data, std::size_t n, match_word* bits) const {
+        detail::combine_batches(t, data, n, bits, std::bit_or<match_word>(),
+                                detail::make_index_sequence<sizeof...(Tp)>());
+    }
+
+    template<typename... Tp>
+    void describe(writer& o, std::tuple<Tp...> const& t) const {
+        o << "any of ";
+        detail::print_operands(o, t, " or ", detail::make_index_sequence<sizeof...(Tp)>());
+    }
+
+private:
+#if __cplusplus >= 201402L
+    template<class ActualType, typename... Tp, std::size_t... I>
+    constexpr bool matches(std::tuple<Tp...> const& t, ActualType const& actual,
+                           detail::index_sequence<I...>) const {
+        bool result = false;
+        (void)detail::expand{0, (result = result || std::get<I>(t).matches(actual), 0)...};
+        return result;
+    }
+#else
+    template<class ActualType, typename... Tp, std::size_t... I>
+    constexpr bool matches(std::tuple<Tp...> const& t, ActualType const& actual,
+                           detail::index_sequence<I...>) const {
+        return detail::operand_chain<std::tuple<Tp...>, ActualType>::template settled<0>(t, actual, true);
+    }
+#endif
+};
+
+template<typename T>
+using AnyOf = Matcher<AnyOf_,T>;
+
+template<typename First, typename... Args>
+constexpr AnyOf<typename detail::composition<AnyOf_,
+    typename std::decay<First>::type, typename std::decay<Args>::type...>::type>
+anyOf(First&& first, Args&&... args)
+{
+    static_assert(is_matcher<typename std::decay<First>::type, typename std::decay<Args>::type...>::value,
+                  "anyOf requires Matcher parameters");
+    return detail::composition<AnyOf_, typename std::decay<First>::type, typename std::decay<Args>::type...>::of(
+        std::forward<First>(first), std::forward<Args>(args)...);
+}
+
+struct AllOf_ {
+protected:
+    template<class ActualType, typename... Tp>
+    constexpr bool matches(std::tuple<Tp...> const& t, ActualType const& actual) const {
+        static_assert(!detail::single_pass<ActualType>::value,
+                      "allOf would match a single-pass range once per operand");
+        return matches(t, actual, detail::by_cost<Tp...>());
+    }
+
+    template<typename T, typename... Tp>
+    typename std::enable_if<detail::all_have_batch<T, Tp...>::value>::type
+    matches_batch(std::tuple<Tp...> const& t, T const* data, std::size_t n, match_word* bits) const {
+        detail::combine_batches(t, data, n, bits, std::bit_and<match_word>(),
+                                detail::make_index_sequence<sizeof...(Tp)>());
+    }
+
+    template<typename... Tp>
+    void describe(writer& o, std::tuple<Tp...> const& t) const {
+        o << "all of ";
+        detail::print_operands(o, t, " and ", detail::make_index_sequence<sizeof...(Tp)>());
+    }
+
+private:
+#if __cplusplus >= 201402L
+    template<class ActualType, typename... Tp, std::size_t... I>
+    constexpr bool matches(std::tuple<Tp...> const& t, ActualType const& actual,
+                           detail::index_sequence<I...>) const {
+        bool result = true;
+        (void)detail::expand{0, (result = result && std::get<I>(t).matches(actual), 0)...};
+        return result;
+    }
+#else
+    template<class ActualType, typename... Tp, std::size_t... I>
+    constexpr bool matches(std::tuple<Tp...> const& t, ActualType const& actual,
+                           detail::index_sequence<I...>) const {
+        return !detail::operand_chain<std::tuple<Tp...>, ActualType>::template settled<0>(t, actual, false);
+    }
+#endif
+};
+
+template<typename T>
+using AllOf = Matcher<AllOf_,T>;
+
+// composites cost what their operands do together, so that one nested in
+// another is tried where that sum puts it
+template<typename... Tp>
+struct matcher_cost<AnyOf_, std::tuple<Tp...>>
+    : std::integral_constant<unsigned, detail::cost_sum(detail::cost_of<Tp>::value...)>
+{ };
+
+template<typename... Tp>
+struct matcher_cost<AllOf_, std::tuple<Tp...>>
+    : std::integral_constant<unsigned, detail::cost_sum(detail::cost_of<Tp>::value...)>
+{ };
+
+namespace detail {
+
+constexpr std::uint64_t pack_order(unsigned) {
+    return 0;
+}
+
+// the operand indices, four bits each, the first tried lowest
+template<typename... Rest>
+constexpr std::uint64_t pack_order(unsigned k, std::size_t first, Rest... rest) {
+    return std::uint64_t(first) << (4 * k) | pack_order(k + 1, rest...);
+}
+
+template<std::size_t... I>
+constexpr std::uint64_t pack_order(index_sequence<I...>) {
+    return pack_order(0, I...);
+}
+
+/*
+ * the operands of an adaptive anyOf or allOf, tried in an order learnt from
+ * the values matched: each operand counts the times it settled the result,
+ * and every adapt_period matches the operands are sorted by how much they
+ * cost per settled result, the counts then halved so that the order follows
+ * the data as it changes. Counts and order are relaxed atomics, a matcher
+ * shared by threads only ever reading a slightly stale order.
+ */
+template<typename Policy, typename Tuple>
+class adaptive_operands;
+
+template<typename Policy, typename... Tp>
+class adaptive_operands<Policy, std::tuple<Tp...>> {
+    static_assert(sizeof...(Tp) <= 16, "adaptive takes up to 16 operands");
+public:
+    typedef Matcher<Policy, std::tuple<Tp...>> matcher_type;
+
+    static constexpr unsigned adapt_period = 4096;
+
+    explicit adaptive_operands(matcher_type matcher)
+        : matcher_(std::move(matcher)), order_(pack_order(by_cost<Tp...>())), calls_(0)
+    {
+        for (auto& count : settled_)
+            count.store(0, std::memory_order_relaxed);
+    }
+
+    adaptive_operands(adaptive_operands const& other)
+        : matcher_(other.matcher_), order_(other.order_.load(std::memory_order_relaxed)), calls_(0)
+    {
+        for (std::size_t i = 0; i < sizeof...(Tp); ++i)
+            settled_[i].store(other.settled_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    matcher_type const& matcher() const {
+        return matcher_;
+    }
+
+    // anyOf is settled by an operand matching, allOf by one not matching
+    template<class ActualType>
+    bool matches(ActualType const& actual, bool settling) const {
+        static test<ActualType> const* tests = table<ActualType>(make_index_sequence<sizeof...(Tp)>());
+        std::uint64_t order = order_.load(std::memory_order_relaxed);
+        bool result = !settling;
+        for (std::size_t k = 0; k < sizeof...(Tp); ++k, order >>= 4) {
+            std::size_t i = order & 15;
+            if (tests[i](matcher_.expected(), actual) == settling) {
+                settled_[i].fetch_add(1, std::memory_order_relaxed);
+                result = settling;
+                break;
+            }
+        }
+        if ((calls_.fetch_add(1, std::memory_order_relaxed) + 1) % adapt_period == 0)
+            adapt();
+        return result;
+    }
+
+private:
+    template<class ActualType>
+    using test = bool (*)(std::tuple<Tp...> const&, ActualType const&);
+
+    template<std::size_t I, class ActualType>
+    static bool test_one(std::tuple<Tp...> const& t, ActualType const& actual) {
+        return std::get<I>(t).matches(actual);
+    }
+
+    template<class ActualType, std::size_t... I>
+    static test<ActualType> const* table(index_sequence<I...>) {
+        static test<ActualType> const tests[] = { &test_one<I, ActualType>... };
+        return tests;
+    }
+
+    void adapt() const {
+        unsigned const cost[] = { cost_of<Tp>::value... };
+        std::uint64_t settled[sizeof...(Tp)];
+        std::size_t order[sizeof...(Tp)];
+        for (std::size_t i = 0; i < sizeof...(Tp); ++i) {
+            settled[i] = settled_[i].load(std::memory_order_relaxed);
+            settled_[i].store(settled[i] / 2, std::memory_order_relaxed);
+            order[i] = i;
+        }
+        // cost[i] / (settled[i] + 1) < cost[j] / (settled[j] + 1), without dividing
+        std::stable_sort(order, order + sizeof...(Tp), [&](std::size_t i, std::size_t j) {
+            return cost[i] * (settled[j] + 1) < cost[j] * (settled[i] + 1);
+        });
+        std::uint64_t packed = 0;
+        for (std::size_t k = 0; k < sizeof...(Tp); ++k)
+            packed |= std::uint64_t(order[k]) << (4 * k);
+        order_.store(packed, std::memory_order_relaxed);
+    }
+
+    matcher_type matcher_;
+    mutable std::atomic<std::uint64_t> order_;
+    mutable std::atomic<unsigned> calls_;
+    mutable std::atomic<std::uint64_t> settled_[sizeof...(Tp)];
+};
+
+} // namespace detail
+
+struct Adaptive_ {
+protected:
+    template<class Policy, class Tuple, class ActualType>
+    bool matches(detail::adaptive_operands<Policy, Tuple> const& operands, ActualType const& actual) const {
+        static_assert(!detail::single_pass<ActualType>::value,
+                      "adaptive would match a single-pass range once per operand");
+        return operands.matches(actual, std::is_same<Policy, AnyOf_>::value);
     }
 
-    template<typename MatcherType>
-    void describe(std::ostream& o, MatcherType const& expected) const {
-        o << "not " << expected;
+    template<class Policy, class Tuple, class ActualType>
+    void describe_mismatch(writer& o, detail::adaptive_operands<Policy, Tuple> const& operands,
+                           ActualType const& actual) const {
+        operands.matcher().describe_mismatch(o, actual);
+    }
+
+    template<class Policy, class Tuple>
+    void describe(writer& o, detail::adaptive_operands<Policy, Tuple> const& operands) const {
+        o << operands.matcher();
     }
 };
 
-template<class T>
-using IsNot = Matcher<IsNot_,T>;
+template<typename T>
+using Adaptive = Matcher<Adaptive_,T>;
 
+template<typename Policy, typename Tuple>
+struct matcher_cost<Adaptive_, detail::adaptive_operands<Policy, Tuple>> : matcher_cost<Policy, Tuple>
+{ };
 
-template<class T>
-constexpr IsNot<T> operator!(T const& value) {
-    static_assert(is_matcher<T>::value, "IsNot matcher requires a Matcher parameter");
-    return IsNot<T>(value);
+/*
+ * anyOf or allOf, trying first the operands which most often settle the
+ * result for their cost, as observed on the values matched so far; for
+ * when the static costs are a poor guess of which operand decides
+ */
+template<typename Policy, typename... Tp>
+Adaptive<detail::adaptive_operands<Policy, std::tuple<Tp...>>>
+adaptive(Matcher<Policy, std::tuple<Tp...>> matcher)
+{
+    static_assert(std::is_same<Policy, AnyOf_>::value || std::is_same<Policy, AllOf_>::value,
+                  "adaptive is for anyOf and allOf");
+    return Adaptive<detail::adaptive_operands<Policy, std::tuple<Tp...>>>(
+        detail::adaptive_operands<Policy, std::tuple<Tp...>>(std::move(matcher)));
 }
 
-struct IsNull {
-protected:
+template<typename First, typename... Args>
+constexpr AllOf<typename detail::composition<AllOf_,
+    typename std::decay<First>::type, typename std::decay<Args>::type...>::type>
+allOf(First&& first, Args&&... args)
+{
+    static_assert(is_matcher<typename std::decay<First>::type, typename std::decay<Args>::type...>::value,
+                  "allOf requires Matcher parameters");
+    return detail::composition<AllOf_, typename std::decay<First>::type, typename std::decay<Args>::type...>::of(
+        std::forward<First>(first), std::forward<Args>(args)...);
+}
+
+struct IsCloseTo_ {
+    static constexpr match_cost cost = cost_cheap;
+
     template<typename T>
-    bool matches(T const* actual) const {
-        return actual == nullptr;
+    constexpr bool matches (std::pair<T,T> const& expected, T const& actual) const {
+        // std::fabs isn't constexpr
+        return (actual < expected.first ? expected.first - actual : actual - expected.first)
+            <= expected.second;
     }
 
-    void describe(std::ostream& o) const {
-        o << "null pointer";
+    template<typename T>
+    void matches_batch(std::pair<T,T> const& expected, T const* data, std::size_t n, match_word* bits) const {
+        detail::batch_apply(data, n, detail::close_pred<T>{expected.first, expected.second}, bits);
+    }
+
+    template<typename T>
+    void describe(writer& o, std::pair<T,T> const& expected) const {
+       o << "a numeric value within +/-" << expected.second
+         << " of " << expected.first;
     }
 };
 
-auto null = make_matcher<IsNull>();
+template<typename T>
+using IsCloseTo = Matcher<IsCloseTo_,T>;
+
+template<typename T>
+constexpr IsCloseTo<std::pair<T,T>> closeTo(T const& operand, T const& error) {
+    static_assert(std::is_floating_point<T>::value, 
+                  "closeTo parameters need be floating-point type");
+    return IsCloseTo<std::pair<T,T>>(std::pair<T,T>(operand, error));
+}
+
+/*
+ * the expected values of an element-wise comparison of contiguous ranges,
+ * with the test of each pair. Ranges given as lvalues are referred to, and
+ * must outlive the matcher; vectors given away are kept.
+ */
+template<typename T, typename Pred>
+class elementwise {
+public:
+    typedef T value_type;
+    typedef T const* const_iterator;
+
+    elementwise(array_ref<T> values, Pred pred) : values_(values), pred_(pred)
+    { }
+
+    elementwise(std::vector<T>&& values, Pred pred)
+        : owned_(std::make_shared<std::vector<T> const>(std::move(values))), values_(*owned_), pred_(pred)
+    { }
+
+    array_ref<T> values() const { return values_; }
+    Pred const& pred() const { return pred_; }
+
+    std::size_t size() const { return values_.size(); }
+    const_iterator begin() const { return values_.begin(); }
+    const_iterator end() const { return values_.end(); }
+
+private:
+    std::shared_ptr<std::vector<T> const> owned_;
+    array_ref<T> values_;
+    Pred pred_;
+};
+
+namespace detail {
 
+template<typename T>
+void describe_pred(writer& o, close_pair_pred<T> const& pred) {
+    o << "each item within +/-" << pred.absolute;
+    if (pred.relative > 0)
+        o << " or " << pred.relative << " relative";
+}
+
+template<typename T>
+void describe_pred(writer& o, ulp_pair_pred<T> const& pred) {
+    o << "each item within " << pred.ulps << (pred.ulps == 1 ? " ulp" : " ulps");
+}
+
+template<typename T>
+void describe_error(writer& o, close_pair_pred<T> const&, double error) {
+    o << "off by " << error;
+}
+
+template<typename T>
+void describe_error(writer& o, ulp_pair_pred<T> const&, double error) {
+    o << std::uint64_t(error) << " ulps away";
+}
+
+} // namespace detail
+
+struct IsElementwiseClose_ {
+    static constexpr match_cost cost = cost_expensive;
 
-struct IsEqual {
 protected:
-    template<typename T>
-    bool matches(T const& expected, T const& actual,
-                 typename std::enable_if<
-                    is_equality_comparable<T>::value
-                    >::type* = 0) const
-    {
-        return expected == actual;
+    template<typename T, typename Pred, typename C,
+         typename std::enable_if<std::is_convertible<C const&, array_ref<T>>::value>::type* = nullptr>
+    bool matches(elementwise<T, Pred> const& expected, C const& actual) const {
+        array_ref<T> const e = expected.values();
+        array_ref<T> const a(actual);
+        return a.size() == e.size() && detail::first_mismatch(e.data(), a.data(), e.size(), expected.pred()) == e.size();
     }
 
-    template<typename T>
-    bool matches(T const& expected, T const& actual,
-                 typename std::enable_if<
-                    !is_equality_comparable<T>::value
-                    && std::is_pod<T>::value
-                    >::type* = 0) const
-    {
-        return !std::memcmp(&expected, &actual, sizeof expected);
+    template<typename T, typename Pred>
+    void describe(writer& o, elementwise<T, Pred> const& expected) const {
+        detail::describe_pred(o, expected.pred());
+        o << " of " << expected;
     }
 
-    template<typename T>
-    void describe(std::ostream& o, T const& expected) const {
-       o << expected;
+    // e.g. 3 of 1000 items out of tolerance, the worst 1.5 at index 17
+    // instead of 1, off by 0.5
+    template<typename T, typename Pred, typename C>
+    void describe_mismatch(writer& o, elementwise<T, Pred> const& expected, C const& actual) const {
+        array_ref<T> const e = expected.values();
+        array_ref<T> const a(actual);
+        if (a.size() != e.size()) {
+            o << a.size() << (a.size() == 1 ? " item" : " items") << " instead of " << e.size();
+            return;
+        }
+        std::size_t failed = 0;
+        std::size_t worst = 0;
+        double worst_error = -1;
+        for (std::size_t i = detail::first_mismatch(e.data(), a.data(), e.size(), expected.pred());
+             i != e.size(); ++i) {
+            if (expected.pred()(e[i], a[i]))
+                continue;
+            ++failed;
+            double const error = expected.pred().error(e[i], a[i]);
+            if (error > worst_error) {
+                worst = i;
+                worst_error = error;
+            }
+        }
+        o << failed << " of " << e.size() << " items out of tolerance, the worst "
+          << a[worst] << " at index " << worst << " instead of " << e[worst] << ", ";
+        detail::describe_error(o, expected.pred(), worst_error);
     }
 };
 
-template<>
-void IsEqual::describe(std::ostream& o, std::string const& expected) const {
-   o << "\"" << expected << "\"";
+template<typename T>
+using IsCloseToEach = Matcher<IsElementwiseClose_, elementwise<T, detail::close_pair_pred<T>>>;
+
+template<typename T>
+using IsWithinUlps = Matcher<IsElementwiseClose_, elementwise<T, detail::ulp_pair_pred<T>>>;
+
+/*
+ * element-wise comparisons of contiguous ranges of floats or doubles, with
+ * vector kernels where the target has them:
+ *
+ *   assertThat(output, closeTo(reference, 1e-9));
+ *   assertThat(output, closeTo(reference, 1e-12, 1e-6, nan_policy::equal));
+ *   assertThat(output, withinUlps(reference, 4));
+ *
+ * Each item matches within the absolute tolerance, or within the relative
+ * one of the larger of the two values; an infinity matches only itself.
+ */
+template<typename C, typename T = typename detail::range_value<C>::type,
+         typename = typename std::enable_if<
+            std::is_floating_point<T>::value && std::is_convertible<C const&, array_ref<T>>::value
+            >::type>
+IsCloseToEach<T> closeTo(C const& expected, typename detail::range_value<C>::type absolute,
+                         typename detail::range_value<C>::type relative = 0, nan_policy nan = nan_policy::mismatch) {
+    return IsCloseToEach<T>(elementwise<T, detail::close_pair_pred<T>>(
+        array_ref<T>(expected), detail::close_pair_pred<T>{absolute, relative, nan}));
 }
 
-auto equalTo = make_matcher<IsEqual>();
+template<typename T, typename = typename std::enable_if<std::is_floating_point<T>::value>::type>
+IsCloseToEach<T> closeTo(std::vector<T>&& expected, typename std::vector<T>::value_type absolute,
+                         typename std::vector<T>::value_type relative = 0, nan_policy nan = nan_policy::mismatch) {
+    return IsCloseToEach<T>(elementwise<T, detail::close_pair_pred<T>>(
+        std::move(expected), detail::close_pair_pred<T>{absolute, relative, nan}));
+}
 
-struct IsContaining_ {
-protected:
-    template<typename C, typename T,
-         typename std::enable_if<std::is_same<typename C::value_type,T>::value>::type* = nullptr>
-    bool matches(T const& item, C const& cont) const {
-        return std::end(cont) != std::find(std::begin(cont), std::end(cont), item);
+template<typename C, typename T = typename detail::range_value<C>::type,
+         typename = typename std::enable_if<
+            std::is_floating_point<T>::value && std::is_convertible<C const&, array_ref<T>>::value
+            >::type>
+IsWithinUlps<T> withinUlps(C const& expected, std::uint64_t ulps, nan_policy nan = nan_policy::mismatch) {
+    return IsWithinUlps<T>(elementwise<T, detail::ulp_pair_pred<T>>(
+        array_ref<T>(expected), detail::ulp_pair_pred<T>{ulps, nan}));
+}
+
+template<typename T, typename = typename std::enable_if<std::is_floating_point<T>::value>::type>
+IsWithinUlps<T> withinUlps(std::vector<T>&& expected, std::uint64_t ulps, nan_policy nan = nan_policy::mismatch) {
+    return IsWithinUlps<T>(elementwise<T, detail::ulp_pair_pred<T>>(
+        std::move(expected), detail::ulp_pair_pred<T>{ulps, nan}));
+}
+
+
+namespace detail {
+
+// a std::regex, defined along with the functions using it
+struct compiled_regex;
+
+} // namespace detail
+
+/*
+ * a regular expression compiled once, when the matcher is built, so that
+ * matching it against many strings doesn't pay for the compilation each
+ * time; copies of the matcher share it
+ */
+class regex_pattern {
+public:
+    // throws std::regex_error when source isn't a valid ECMAScript pattern
+    MATCHA_INLINE regex_pattern(std::string const& source = std::string());
+
+    std::string const& str() const { return source_; }
+
+    // whether it matches the whole of text
+    MATCHA_INLINE bool match(string_ref text) const;
+
+private:
+    std::string source_;
+    std::shared_ptr<detail::compiled_regex const> regex_;
+};
+
+struct MatchesPattern_ {
+    static constexpr match_cost cost = cost_expensive;
+
+    bool matches(regex_pattern const& reg, string_ref actual) const {
+        return reg.match(actual);
     }
 
-    template<typename T, size_t N>
-    bool matches(T const& item, T const (&array)[N]) const {
-        return std::end(array) != std::find(std::begin(array), std::end(array), item);
+    void describe(writer& o, regex_pattern const& expected) const {
+       o << "a string matching the pattern " << expected.str();
     }
+};
 
-    template<typename C = std::string, typename T = std::string>
-    bool matches(std::string const& substr, std::string const& actual) const {
-        return std::string::npos != actual.find(substr);
+using MatchesPattern = Matcher<MatchesPattern_,regex_pattern>;
+
+inline MatchesPattern matchesPattern(std::string const& reg_exp) {
+    return MatchesPattern(reg_exp);
+}
+
+inline MatchesPattern matches(std::string const& reg_exp) {
+    return MatchesPattern(reg_exp);
+}
+
+/*
+ * pattern known at compile time, given as a type with a static value()
+ * member function, e.g.
+ *
+ *   struct Ipv4 { static const char* value() { return "([0-9]{1,3}\\.){3}[0-9]{1,3}"; } };
+ *   assertThat(address, matchesPattern<Ipv4>());
+ *
+ * the regex is compiled once per program, on first use
+ */
+template<typename Pattern>
+struct MatchesStaticPattern_ {
+    static constexpr match_cost cost = cost_expensive;
+
+    bool matches(string_ref actual) const {
+        return regex().match(actual);
     }
 
-    // overload for checking whether container values match a predicate specified by a Matcher
-    template<typename C, typename T, typename Policy,
-         typename std::enable_if<std::is_same<typename C::value_type,T>::value>::type* = nullptr>
-    bool matches(Matcher<Policy,T> const& itemMatcher, C const& cont) const {
-        auto pred = std::bind(&Matcher<Policy,T>::template matches<T>, &itemMatcher, std::placeholders::_1);
-        return std::all_of(std::begin(cont), std::end(cont), pred);
+    void describe(writer& o) const {
+       o << "a string matching the pattern " << Pattern::value();
+    }
+
+private:
+    static regex_pattern const& regex() {
+        static const regex_pattern re(Pattern::value());
+        return re;
+    }
+};
+
+template<typename Pattern>
+using MatchesStaticPattern = Matcher<MatchesStaticPattern_<Pattern>>;
+
+template<typename Pattern>
+MatchesStaticPattern<Pattern> matchesPattern() {
+    return MatchesStaticPattern<Pattern>();
+}
+
+template<typename Pattern>
+MatchesStaticPattern<Pattern> matches() {
+    return MatchesStaticPattern<Pattern>();
+}
+
+namespace detail {
+
+// the function objects' call operators are only constexpr since C++14
+template<typename T>
+constexpr bool compare(std::less<T>, T const& a, T const& b) { return a < b; }
+
+template<typename T>
+constexpr bool compare(std::less_equal<T>, T const& a, T const& b) { return a <= b; }
+
+template<typename T>
+constexpr bool compare(std::greater<T>, T const& a, T const& b) { return a > b; }
+
+template<typename T>
+constexpr bool compare(std::greater_equal<T>, T const& a, T const& b) { return a >= b; }
+
+} // namespace detail
+
+template<typename F>
+struct OrderingComparison {
+    static constexpr match_cost cost = cost_cheap;
+
+protected:
+    template<typename T>
+    constexpr bool matches(T const& expected, T const& actual) const {
+        return detail::compare(F(), actual, expected);
     }
 
     template<typename T>
-    void describe(std::ostream& o, T const& expected) const {
-       o << "contains " << expected;
+    typename std::enable_if<std::is_arithmetic<T>::value>::type
+    matches_batch(T const& expected, T const* data, std::size_t n, match_word* bits) const {
+        detail::batch_apply(data, n, detail::compare_pred<T, F>{expected}, bits);
     }
+};
 
-    template<typename T, typename Policy>
-    void describe(std::ostream& o, Matcher<Policy,T> const& expected) const {
-       o << "every item " << expected;
+template<typename T>
+struct LessThan : OrderingComparison<std::less<T>> {
+protected:
+    void describe(writer& o, T const& expected) const {
+        o << "less than " << expected;
     }
 };
 
-template<>
-void IsContaining_::describe(std::ostream& o, std::string const& expected) const {
-   o << "contains " << "\"" << expected << "\"";
+template<typename T>
+constexpr Matcher<LessThan<T>,T> lessThan(T const& value) {
+    return Matcher<LessThan<T>,T>(value);
 }
 
-template<class T>
-using IsContaining = Matcher<IsContaining_,T>;
+template<typename T>
+struct GreaterThan : OrderingComparison<std::greater<T>> {
+protected:
+    void describe(writer& o, T const& expected) const {
+        o << "greater than " << expected;
+    }
+};
 
 template<typename T>
-constexpr IsContaining<T> contains(T const& value) {
-    return IsContaining<T>(value);
+constexpr Matcher<GreaterThan<T>,T> greaterThan(T const& value) {
+    return Matcher<GreaterThan<T>,T>(value);
 }
 
-template<typename T, size_t N>
-constexpr IsContaining<T[N]> contains(T const (&value)[N]) {
-    return IsContaining<T[N]>(value);
+template<typename T>
+struct GreaterThanOrEqual : OrderingComparison<std::greater_equal<T>> {
+protected:
+    void describe(writer& o, T const& expected) const {
+        o << "greater than or equal to " << expected;
+    }
+};
+
+template<typename T>
+constexpr Matcher<GreaterThanOrEqual<T>,T> greaterThanOrEqualTo(T const& value) {
+    return Matcher<GreaterThanOrEqual<T>,T>(value);
 }
 
-template<class Key, class T>
-constexpr IsContaining<std::pair<const Key,T>> contains(Key const& key, T const& value) {
-    return IsContaining<std::pair<const Key,T>>(std::pair<const Key,T>(key, value));
+template<typename T>
+struct LessThanOrEqual : OrderingComparison<std::less_equal<T>> {
+protected:
+    void describe(writer& o, T const& expected) const {
+        o << "less than or equal to " << expected;
+    }
+};
+
+template<typename T>
+constexpr Matcher<LessThanOrEqual<T>,T> lessThanOrEqualTo(T const& value) {
+    return Matcher<LessThanOrEqual<T>,T>(value);
 }
 
-template<typename T, typename Policy>
-constexpr IsContaining<Matcher<Policy,T>> everyItem(Matcher<Policy,T> const& itemMatcher) {
-    return IsContaining<Matcher<Policy,T>>(itemMatcher);
-}
+namespace detail {
+
+/*
+ * any matcher of values of type T, behind one table of functions. The
+ * matcher is kept inline when it is small enough and can be moved without
+ * throwing, which is the case of the comparisons and of the string matchers,
+ * and on the heap otherwise; either way matching is one indirect call.
+ */
+template<typename T>
+class erased_matcher {
+public:
+    static constexpr std::size_t inline_size = 6 * sizeof(void*);
+
+    template<typename M, typename = typename std::enable_if<is_matcher<typename std::decay<M>::type>::value>::type>
+    explicit erased_matcher(M&& matcher) : ops_(&ops_for<typename std::decay<M>::type>::ops) {
+        ops_for<typename std::decay<M>::type>::create(&storage_, std::forward<M>(matcher));
+    }
+
+    erased_matcher(erased_matcher const& other) : ops_(other.ops_) {
+        ops_->copy(&other.storage_, &storage_);
+    }
+
+    erased_matcher(erased_matcher&& other) noexcept : ops_(other.ops_) {
+        ops_->move(&other.storage_, &storage_);
+    }
+
+    erased_matcher& operator=(erased_matcher const& other) {
+        if (this != &other) {
+            erased_matcher copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    erased_matcher& operator=(erased_matcher&& other) noexcept {
+        if (this != &other) {
+            ops_->destroy(&storage_);
+            ops_ = other.ops_;
+            ops_->move(&other.storage_, &storage_);
+        }
+        return *this;
+    }
+
+    ~erased_matcher() {
+        ops_->destroy(&storage_);
+    }
+
+    bool matches(T const& actual) const {
+        return ops_->matches(&storage_, actual);
+    }
+
+    void describe(writer& o) const {
+        ops_->describe(&storage_, o);
+    }
+
+    void describe_mismatch(writer& o, T const& actual) const {
+        ops_->describe_mismatch(&storage_, o, actual);
+    }
+
+private:
+    typedef typename std::aligned_storage<inline_size, alignof(std::max_align_t)>::type storage;
+
+    struct operations {
+        bool (*matches)(void const*, T const&);
+        void (*describe)(void const*, writer&);
+        void (*describe_mismatch)(void const*, writer&, T const&);
+        void (*copy)(void const*, void*);
+        void (*move)(void*, void*);     // leaves the source only fit for destroying
+        void (*destroy)(void*);
+    };
+
+    template<typename M, bool = sizeof(M) <= inline_size && alignof(M) <= alignof(std::max_align_t)
+                                && std::is_nothrow_move_constructible<M>::value>
+    struct ops_for {
+        static M const& get(void const* p) {
+            return *static_cast<M const*>(p);
+        }
+
+        template<typename A>
+        static void create(void* p, A&& matcher) {
+            new (p) M(std::forward<A>(matcher));
+        }
+
+        static void copy(void const* from, void* to) {
+            new (to) M(get(from));
+        }
+
+        static void move(void* from, void* to) {
+            new (to) M(std::move(*static_cast<M*>(from)));
+        }
+
+        static void destroy(void* p) {
+            static_cast<M*>(p)->~M();
+        }
+
+        static const operations ops;
+    };
+
+    template<typename M>
+    struct ops_for<M, false> {
+        static M const& get(void const* p) {
+            return **static_cast<M* const*>(p);
+        }
+
+        template<typename A>
+        static void create(void* p, A&& matcher) {
+            *static_cast<M**>(p) = new M(std::forward<A>(matcher));
+        }
+
+        static void copy(void const* from, void* to) {
+            *static_cast<M**>(to) = new M(get(from));
+        }
 
-struct IsContainingKey {
-protected:
-    template<typename C, typename T,
-         typename std::enable_if<std::is_same<typename C::key_type,T>::value>::type* = nullptr>
-    bool matches(T const& key, C const& cont) const {
-        for (auto const& val : cont) {
-            if (val.first == key)
-                return true;
+        static void move(void* from, void* to) {
+            *static_cast<M**>(to) = *static_cast<M**>(from);
+            *static_cast<M**>(from) = nullptr;
         }
-        return false;
-    }
 
-    template<typename T>
-    void describe(std::ostream& o, T const& expected) const {
-       o << "has key " << expected;
-    }
-};
+        static void destroy(void* p) {
+            delete *static_cast<M**>(p);
+        }
 
-auto hasKey = make_matcher<IsContainingKey>();
+        static const operations ops;
+    };
 
-struct IsIn_ {
-protected:
-    template<typename C, typename T,
-         typename std::enable_if<std::is_same<typename C::value_type,T>::value>::type* = nullptr>
-    bool matches(C const& cont, T const& item) const {
-        return std::end(cont) != std::find(std::begin(cont), std::end(cont), item);
+    template<typename M, typename Ops>
+    static bool matches_of(void const* p, T const& actual) {
+        return Ops::get(p).matches(actual);
     }
 
-    template<typename T, size_t N>
-    bool matches(T const (&array)[N], T const& item) const {
-        return std::end(array) != std::find(std::begin(array), std::end(array), item);
+    template<typename M, typename Ops>
+    static void describe_of(void const* p, writer& o) {
+        o << Ops::get(p);
     }
 
-    template<typename C>
-    void describe(std::ostream& o, C const& expected) const {
-       o << "one of " << expected;
+    template<typename M, typename Ops>
+    static void describe_mismatch_of(void const* p, writer& o, T const& actual) {
+        Ops::get(p).describe_mismatch(o, actual);
     }
 
+    operations const* ops_;
+    storage storage_;
 };
 
-template<typename C>
-using IsIn = Matcher<IsIn_,C>;
-
-template<typename C>
-constexpr IsIn<C> in(C const& cont) {
-    return IsIn<C>(cont);
-}
+template<typename T>
+template<typename M, bool Inline>
+const typename erased_matcher<T>::operations erased_matcher<T>::ops_for<M, Inline>::ops = {
+    &erased_matcher<T>::template matches_of<M, ops_for<M, Inline>>,
+    &erased_matcher<T>::template describe_of<M, ops_for<M, Inline>>,
+    &erased_matcher<T>::template describe_mismatch_of<M, ops_for<M, Inline>>,
+    &ops_for<M, Inline>::copy,
+    &ops_for<M, Inline>::move,
+    &ops_for<M, Inline>::destroy
+};
 
-template<typename T, typename... Args>
-IsIn<std::vector<T>> oneOf(T const& first, Args const& ... args) {
-    std::vector<T> cont{first, args...};
-    return IsIn<std::vector<T>>(cont);
-}
+template<typename T>
+template<typename M>
+const typename erased_matcher<T>::operations erased_matcher<T>::ops_for<M, false>::ops = {
+    &erased_matcher<T>::template matches_of<M, ops_for<M, false>>,
+    &erased_matcher<T>::template describe_of<M, ops_for<M, false>>,
+    &erased_matcher<T>::template describe_mismatch_of<M, ops_for<M, false>>,
+    &ops_for<M, false>::copy,
+    &ops_for<M, false>::move,
+    &ops_for<M, false>::destroy
+};
 
-template<size_t M, size_t... N>
-IsIn<std::vector<std::string>> oneOf(const char (&first)[M], const char (&...args)[N]) {
-    std::vector<std::string> cont{first, args...};
-    return IsIn<std::vector<std::string>>(cont);
-}
+} // namespace detail
 
-struct IsEmpty_ {
+struct AnyMatcher_ {
 protected:
-    template<typename C>
-    bool matches(C const& actual) const {
-        static_assert(pretty_print::is_container<C>::value, "empty matcher is for std containers");
-        return actual.empty();
+    template<class T>
+    bool matches(detail::erased_matcher<T> const& matcher, T const& actual) const {
+        return matcher.matches(actual);
     }
 
-    void describe(std::ostream& o) const {
-        o << "an empty container";
+    template<class T>
+    void describe_mismatch(writer& o, detail::erased_matcher<T> const& matcher, T const& actual) const {
+        matcher.describe_mismatch(o, actual);
+    }
+
+    template<class T>
+    void describe(writer& o, detail::erased_matcher<T> const& matcher) const {
+        matcher.describe(o);
     }
 };
 
-using IsEmpty = Matcher<IsEmpty_>;
+/*
+ * a matcher of values of type T whose type doesn't say what it matches, for
+ * keeping matchers built at run time in containers or passing them across
+ * an interface:
+ *
+ *   std::vector<AnyMatcher<int>> rules;
+ *   rules.push_back(greaterThan(0));
+ *   rules.push_back(anyOf(equalTo(-1), lessThan(-100)));
+ */
+template<typename T>
+class AnyMatcher : public Matcher<AnyMatcher_, detail::erased_matcher<T>> {
+public:
+    template<class MatcherPolicy, class ExpectedType>
+    AnyMatcher(Matcher<MatcherPolicy, ExpectedType> const& matcher)
+        : Matcher<AnyMatcher_, detail::erased_matcher<T>>(detail::erased_matcher<T>(matcher))
+    { }
 
-constexpr IsEmpty empty() {
-    return IsEmpty();
-}
+    template<class MatcherPolicy, class ExpectedType>
+    AnyMatcher(Matcher<MatcherPolicy, ExpectedType>&& matcher)
+        : Matcher<AnyMatcher_, detail::erased_matcher<T>>(detail::erased_matcher<T>(std::move(matcher)))
+    { }
 
-struct IsEmptyString_ {
-protected:
-    bool matches(std::string const& actual) const {
-        return actual.empty();
+    AnyMatcher(Matcher<AnyMatcher_, detail::erased_matcher<T>> const& matcher)
+        : Matcher<AnyMatcher_, detail::erased_matcher<T>>(matcher)
+    { }
+
+    friend writer& operator<<(writer& o, AnyMatcher const& matcher) {
+        return o << static_cast<Matcher<AnyMatcher_, detail::erased_matcher<T>> const&>(matcher);
     }
 
-    void describe(std::ostream& o) const {
-        o << "an empty string";
+    friend std::ostream& operator<<(std::ostream& o, AnyMatcher const& matcher) {
+        return o << static_cast<Matcher<AnyMatcher_, detail::erased_matcher<T>> const&>(matcher);
     }
 };
 
-using IsEmptyString = Matcher<IsEmptyString_>;
+template<typename T>
+struct is_matcher<AnyMatcher<T>> : std::true_type
+{ };
 
-constexpr IsEmptyString emptyString() {
-    return IsEmptyString();
-}
+namespace detail {
 
-struct IsEqualIgnoringCase_ {
-protected:
-    bool matches(std::string const& expected, std::string const& actual) const {
-        ci_string ci_exp, ci_act;
+template<typename T>
+struct cost_of<AnyMatcher<T>> : matcher_cost<AnyMatcher_, erased_matcher<T>>
+{ };
 
-        ci_exp.assign(expected.begin(), expected.end());
-        ci_act.assign(actual.begin(), actual.end());
-        return ci_exp == ci_act;
-    }
+} // namespace detail
 
-    void describe(std::ostream& o, std::string const& expected) const {
-       o << "Equal to " << "\"" << expected << "\"" << " ignoring case";
-    }
-};
+/*
+ * matchers fed the items of a stream one at a time, for streams too long to
+ * be kept, like the events of a soak test:
+ *
+ *   auto monitor = incremental<event>(allOf(everyItem(fasterThan(5ms)), isSorted()));
+ *   for (event const& e : telemetry)
+ *       if (monitor.feed(e) == verdict::mismatched)
+ *           break;
+ *   monitor.finish();
+ *   assertThat(monitor, holds());
+ *
+ * An item takes constant time, and the state constant memory, however long
+ * the stream: nothing is kept of it but the item before for isSorted, and
+ * the one which settled the verdict, as it is printed, for the failure
+ * message. The verdict is settled by the first item which decides it, the
+ * first mismatch of everyItem or the first match of contains; at the end of
+ * the stream finish() settles what is still pending. everyItem, contains,
+ * isSorted, empty and hasSize can be fed, and is, not, anyOf and allOf of
+ * them.
+ */
+enum class verdict { pending, matched, mismatched };
 
-using IsEqualIgnoringCase = Matcher<IsEqualIgnoringCase_,std::string>;
+namespace detail {
 
-IsEqualIgnoringCase equalToIgnoringCase(std::string const& val) {
-    return IsEqualIgnoringCase(val);
-}
+// the state of matcher M fed items of type T, specialized for the matchers
+// which can be; feed() and finish() are only called while it is pending,
+// and describe() writes what settled it, if that was more than the count
+template<typename M, typename T, typename = void>
+class stream_state {
+    static_assert(sizeof(M) == 0, "this matcher can't be fed the items of a stream");
+};
 
-struct IsEqualIgnoringWhiteSpace_ {
-protected:
-    bool matches(std::string const& expected, std::string const& actual) const {
-        std::string exp(expected), act(actual);
+class stream_verdict {
+public:
+    stream_verdict() : verdict_(verdict::pending)
+    { }
 
-        exp.erase(std::remove_if(exp.begin(),
-                                 exp.end(),
-                                 [](char x){return std::isspace(x);}),
-                  exp.end());
-        act.erase(std::remove_if(act.begin(),
-                                 act.end(),
-                                 [](char x){return std::isspace(x);}),
-                  act.end());
-        return exp == act;
+    verdict result() const {
+        return verdict_;
     }
 
-    void describe(std::ostream& o, std::string const& expected) const {
-       o << "Equal to " << "\"" << expected << "\"" << " ignoring white space";
+    bool describe(writer& o) const {
+        o << evidence_;
+        return !evidence_.empty();
     }
-};
 
-using IsEqualIgnoringWhiteSpace = Matcher<IsEqualIgnoringWhiteSpace_,std::string>;
-
-IsEqualIgnoringWhiteSpace equalToIgnoringWhiteSpace(std::string const& val) {
-    return IsEqualIgnoringWhiteSpace(val);
-}
-
-struct StringStartsWith_ {
 protected:
-    bool matches(std::string const& substr, std::string const& actual) const {
-        return !actual.compare(0, substr.size(), substr);
+    void settle(verdict v) {
+        verdict_ = v;
     }
 
-    void describe(std::ostream& o, std::string const& expected) const {
-       o << "starts with " << "\"" << expected << "\"";
+    void settle(verdict v, std::string evidence) {
+        verdict_ = v;
+        evidence_ = std::move(evidence);
     }
-};
 
-using StringStartsWith = Matcher<StringStartsWith_,std::string>;
+    template<typename T>
+    void settle(verdict v, T const& item, std::uint64_t offset) {
+        writer w;
+        w << item << " at offset " << offset;
+        settle(v, w.str());
+    }
 
-StringStartsWith startsWith(std::string const& val) {
-    return StringStartsWith(val);
-}
+private:
+    verdict verdict_;
+    std::string evidence_;
+};
 
-struct StringEndsWith_ {
-protected:
-    bool matches(std::string const& substr, std::string const& actual) const {
-        return !actual.compare(actual.size() - substr.size(), substr.size(), substr);
+// everyItem
+template<typename Policy, typename E, typename T>
+class stream_state<Matcher<IsContaining_, Matcher<Policy, E>>, T> : public stream_verdict {
+public:
+    template<typename M>
+    void feed(M const& m, T const& item, std::uint64_t offset) {
+        if (!m.expected().matches(item))
+            settle(verdict::mismatched, item, offset);
     }
 
-    void describe(std::ostream& o, std::string const& expected) const {
-       o << "ends with " << "\"" << expected << "\"";
+    template<typename M>
+    void finish(M const&, std::uint64_t) {
+        settle(verdict::matched);
     }
 };
 
-using StringEndsWith = Matcher<StringEndsWith_,std::string>;
+template<typename T, typename E>
+bool stream_item_is(T const& item, E const& expected) {
+    return item == expected;
+}
 
-StringEndsWith endsWith(std::string const& val) {
-    return StringEndsWith(val);
+template<typename T>
+bool stream_item_is(T const& item, substring const& expected) {
+    return item == expected.str();
 }
 
-struct AnyOf_ {
-protected:
-    template<class ActualType, std::size_t I = 0, typename... Tp>
-    typename std::enable_if<I == sizeof...(Tp), bool>::type
-    matches(std::tuple<Tp...> const& t, ActualType const& actual) const {
-        return false;
+// contains an item
+template<typename E, typename T>
+class stream_state<Matcher<IsContaining_, E>, T,
+                   typename std::enable_if<!is_matcher<E>::value>::type> : public stream_verdict {
+public:
+    template<typename M>
+    void feed(M const& m, T const& item, std::uint64_t offset) {
+        if (stream_item_is(item, m.expected()))
+            settle(verdict::matched, item, offset);
     }
 
-    template<class ActualType, std::size_t I = 0, typename... Tp>
-    typename std::enable_if<I < sizeof...(Tp), bool>::type
-    matches(std::tuple<Tp...> const& t, ActualType const& actual) const {
-        return std::get<I>(t).matches(actual) || matches<ActualType, I + 1, Tp...>(t, actual);
+    template<typename M>
+    void finish(M const&, std::uint64_t) {
+        settle(verdict::mismatched);
     }
+};
 
-    template<typename... Tp>
-    void describe(std::ostream& o, std::tuple<Tp...> const& t) const {
-        o << "any of ";
-        printall(o, t);
+template<typename T>
+class stream_state<Matcher<IsEmpty_, void>, T> : public stream_verdict {
+public:
+    template<typename M>
+    void feed(M const&, T const& item, std::uint64_t offset) {
+        settle(verdict::mismatched, item, offset);
     }
 
-private:
-    template<std::size_t I = 0, typename... Tp>
-    typename std::enable_if<I == sizeof...(Tp) - 1, void>::type
-    printall(std::ostream& o, std::tuple<Tp...> const& t) const {
-        o << std::get<I>(t) << ".";
+    template<typename M>
+    void finish(M const&, std::uint64_t) {
+        settle(verdict::matched);
+    }
+};
+
+// settled by the item after the last one expected, if there is one
+template<typename T>
+class stream_state<Matcher<HasSize_, std::size_t>, T> : public stream_verdict {
+public:
+    template<typename M>
+    void feed(M const& m, T const& item, std::uint64_t offset) {
+        if (offset >= m.expected())
+            settle(verdict::mismatched, item, offset);
     }
 
-    template<std::size_t I = 0, typename... Tp>
-    typename std::enable_if<I < sizeof...(Tp) - 1, void>::type
-    printall(std::ostream& o, std::tuple<Tp...> const& t) const {
-        o << std::get<I>(t) << " or ";
-        printall<I + 1, Tp...>(o, t);
+    template<typename M>
+    void finish(M const& m, std::uint64_t count) {
+        settle(count == m.expected() ? verdict::matched : verdict::mismatched);
     }
 };
 
+// the item before is kept in a vector of one, so that T needn't have a
+// default constructor and the state can still be copied
 template<typename T>
-using AnyOf = Matcher<AnyOf_,T>;
+class stream_state<Matcher<IsSorted_, void>, T> : public stream_verdict {
+public:
+    template<typename M>
+    void feed(M const&, T const& item, std::uint64_t offset) {
+        if (last_.empty()) {
+            last_.push_back(item);
+        }
+        else if (item < last_[0]) {
+            writer w;
+            w << item << " at offset " << offset << " after " << last_[0];
+            settle(verdict::mismatched, w.str());
+            last_.clear();
+        }
+        else {
+            last_[0] = item;
+        }
+    }
 
-template<typename First, typename... Args>
-constexpr AnyOf<std::tuple<First,Args...>> anyOf(First first, Args... args)
-{
-    static_assert(is_matcher<First, Args...>::value, "anyOf requires Matcher parameters");
-    return AnyOf<std::tuple<First,Args...>>(std::make_tuple(first, args...));
-}
+    template<typename M>
+    void finish(M const&, std::uint64_t) {
+        settle(verdict::matched);
+    }
 
-struct AllOf_ {
-protected:
-    template<class ActualType, std::size_t I = 0, typename... Tp>
-    typename std::enable_if<I == sizeof...(Tp), bool>::type
-    matches(std::tuple<Tp...> const& t, ActualType const& actual) const {
-        return true;
+private:
+    std::vector<T> last_;
+};
+
+template<typename Inner, typename T>
+class stream_state<Matcher<Is, Inner>, T> {
+public:
+    verdict result() const {
+        return inner_.result();
     }
 
-    template<class ActualType, std::size_t I = 0, typename... Tp>
-    typename std::enable_if<I < sizeof...(Tp), bool>::type
-    matches(std::tuple<Tp...> const& t, ActualType const& actual) const {
-        return std::get<I>(t).matches(actual) && matches<ActualType, I + 1, Tp...>(t, actual);
+    template<typename M>
+    void feed(M const& m, T const& item, std::uint64_t offset) {
+        inner_.feed(m.expected(), item, offset);
     }
 
-    template<typename... Tp>
-    void describe(std::ostream& o, std::tuple<Tp...> const& t) const {
-        o << "all of ";
-        printall(o, t);
+    template<typename M>
+    void finish(M const& m, std::uint64_t count) {
+        inner_.finish(m.expected(), count);
+    }
+
+    bool describe(writer& o) const {
+        return inner_.describe(o);
     }
 
 private:
-    template<std::size_t I = 0, typename... Tp>
-    typename std::enable_if<I == sizeof...(Tp) - 1, void>::type
-    printall(std::ostream& o, std::tuple<Tp...> const& t) const {
-        o << std::get<I>(t) << ".";
+    stream_state<Inner, T> inner_;
+};
+
+template<typename Inner, typename T>
+class stream_state<Matcher<IsNot_, Inner>, T> {
+public:
+    verdict result() const {
+        verdict const v = inner_.result();
+        return v == verdict::matched ? verdict::mismatched
+             : v == verdict::mismatched ? verdict::matched : verdict::pending;
+    }
+
+    template<typename M>
+    void feed(M const& m, T const& item, std::uint64_t offset) {
+        inner_.feed(m.expected(), item, offset);
+    }
+
+    template<typename M>
+    void finish(M const& m, std::uint64_t count) {
+        inner_.finish(m.expected(), count);
     }
 
-    template<std::size_t I = 0, typename... Tp>
-    typename std::enable_if<I < sizeof...(Tp) - 1, void>::type
-    printall(std::ostream& o, std::tuple<Tp...> const& t) const {
-        o << std::get<I>(t) << " and ";
-        printall<I + 1, Tp...>(o, t);
+    bool describe(writer& o) const {
+        return inner_.describe(o);
     }
+
+private:
+    stream_state<Inner, T> inner_;
 };
 
-template<typename T>
-using AllOf = Matcher<AllOf_,T>;
+// anyOf and allOf: the operands still pending are fed, until one settles
+// the whole, which the settled operands then describe
+template<typename Policy, typename T, typename... Tp>
+class stream_composite {
+public:
+    stream_composite() : verdict_(verdict::pending)
+    { }
 
-template<typename First, typename... Args>
-constexpr AllOf<std::tuple<First,Args...>> allOf(First first, Args... args)
-{
-    static_assert(is_matcher<First, Args...>::value, "allOf requires Matcher parameters");
-    return AllOf<std::tuple<First,Args...>>(std::make_tuple(first, args...));
-}
+    verdict result() const {
+        return verdict_;
+    }
 
-struct IsCloseTo_ {
-    template<typename T>
-    bool matches (std::pair<T,T> const& expected, T const& actual) const {
-        T value = expected.first;
-        T delta = expected.second;
+    template<typename M>
+    void feed(M const& m, T const& item, std::uint64_t offset) {
+        feed(m.expected(), item, offset, make_index_sequence<sizeof...(Tp)>());
+    }
 
-        return std::fabs(actual - value) <= delta;
+    template<typename M>
+    void finish(M const& m, std::uint64_t count) {
+        finish(m.expected(), count, make_index_sequence<sizeof...(Tp)>());
     }
 
-    template<typename T>
-    void describe(std::ostream& o, std::pair<T,T> const& expected) const {
-       o << "a numeric value within +/-" << expected.second
-         << " of " << expected.first;
+    bool describe(writer& o) const {
+        return describe(o, make_index_sequence<sizeof...(Tp)>());
     }
-};
 
-template<typename T>
-using IsCloseTo = Matcher<IsCloseTo_,T>;
+private:
+    // anyOf is settled by a match, allOf by a mismatch
+    static constexpr verdict decisive = std::is_same<Policy, AnyOf_>::value ? verdict::matched : verdict::mismatched;
+
+    template<std::size_t... I>
+    void feed(std::tuple<Tp...> const& t, T const& item, std::uint64_t offset, index_sequence<I...>) {
+        (void)expand{0, (std::get<I>(states_).result() == verdict::pending
+                         ? (std::get<I>(states_).feed(std::get<I>(t), item, offset), 0) : 0)...};
+        settle(index_sequence<I...>());
+    }
 
-template<typename T>
-constexpr IsCloseTo<std::pair<T,T>> closeTo(T const& operand, T const& error) {
-    static_assert(std::is_floating_point<T>::value, 
-                  "closeTo parameters need be floating-point type");
-    return IsCloseTo<std::pair<T,T>>(std::make_pair(operand, error));
-}
+    template<std::size_t... I>
+    void finish(std::tuple<Tp...> const& t, std::uint64_t count, index_sequence<I...>) {
+        (void)expand{0, (std::get<I>(states_).result() == verdict::pending
+                         ? (std::get<I>(states_).finish(std::get<I>(t), count), 0) : 0)...};
+        settle(index_sequence<I...>());
+    }
 
+    template<std::size_t... I>
+    void settle(index_sequence<I...>) {
+        bool any_decisive = false;
+        bool all_settled = true;
+        (void)expand{0, (any_decisive = any_decisive || std::get<I>(states_).result() == decisive,
+                         all_settled = all_settled && std::get<I>(states_).result() != verdict::pending, 0)...};
+        if (any_decisive)
+            verdict_ = decisive;
+        else if (all_settled)
+            verdict_ = decisive == verdict::matched ? verdict::mismatched : verdict::matched;
+    }
 
-struct MatchesPattern_ {
-    bool matches(std::string const& reg, std::string const& actual) const {
-        return std::regex_match(actual, std::regex(reg));
+    template<std::size_t... I>
+    bool describe(writer& o, index_sequence<I...>) const {
+        bool written = false;
+        (void)expand{0, (std::get<I>(states_).result() == verdict_
+                         ? (describe_operand(o, std::get<I>(states_), written), 0) : 0)...};
+        return written;
     }
 
-    void describe(std::ostream& o, std::string const& expected) const {
-       o << "a string matching the pattern " << expected;
+    template<typename S>
+    static void describe_operand(writer& o, S const& state, bool& written) {
+        writer w;
+        if (state.describe(w)) {
+            o << (written ? ", " : "") << w.str();
+            written = true;
+        }
     }
+
+    std::tuple<stream_state<Tp, T>...> states_;
+    verdict verdict_;
 };
 
-using MatchesPattern = Matcher<MatchesPattern_,std::string>;
+template<typename T, typename... Tp>
+class stream_state<Matcher<AnyOf_, std::tuple<Tp...>>, T> : public stream_composite<AnyOf_, T, Tp...>
+{ };
 
-MatchesPattern matchesPattern(std::string const& reg_exp) {
-    return MatchesPattern(reg_exp);
-}
+template<typename T, typename... Tp>
+class stream_state<Matcher<AllOf_, std::tuple<Tp...>>, T> : public stream_composite<AllOf_, T, Tp...>
+{ };
 
-MatchesPattern matches(std::string const& reg_exp) {
-    return MatchesPattern(reg_exp);
-}
+} // namespace detail
 
-template<typename F>
-struct OrderingComparison {
-protected:
-    template<typename T>
-    bool matches(T const& expected, T const& actual) const {
-        F op = F();
-        return op(actual, expected);
+/*
+ * a matcher of the items of a stream, of type T, fed to it one by one; it
+ * isn't safe to feed from several threads at once
+ */
+template<typename T, typename M>
+class incremental_matcher {
+public:
+    explicit incremental_matcher(M matcher)
+        : matcher_(std::move(matcher)), count_(0), finished_(false)
+    { }
+
+    // the next item, which is only matched while the verdict is pending
+    verdict feed(T const& item) {
+        if (state_.result() == verdict::pending && !finished_)
+            state_.feed(matcher_, item, count_);
+        ++count_;
+        return state_.result();
     }
-};
 
-template<typename T>
-struct LessThan : OrderingComparison<std::less<T>> {
-protected:
-    void describe(std::ostream& o, T const& expected) const {
-        o << "less than " << expected;
+    verdict state() const {
+        return state_.result();
     }
-};
 
-template<typename T>
-Matcher<LessThan<T>,T> lessThan(T const& value) {
-    return Matcher<LessThan<T>,T>(value);
-}
+    // the end of the stream, which settles a pending verdict
+    verdict finish() {
+        if (state_.result() == verdict::pending && !finished_)
+            state_.finish(matcher_, count_);
+        finished_ = true;
+        return state_.result();
+    }
 
-template<typename T>
-struct GreaterThan : OrderingComparison<std::greater<T>> {
-protected:
-    void describe(std::ostream& o, T const& expected) const {
-        o << "greater than " << expected;
+    bool finished() const {
+        return finished_;
     }
-};
 
-template<typename T>
-Matcher<GreaterThan<T>,T> greaterThan(T const& value) {
-    return Matcher<GreaterThan<T>,T>(value);
-}
+    // items fed so far
+    std::uint64_t count() const {
+        return count_;
+    }
 
-template<typename T>
-struct GreaterThanOrEqual : OrderingComparison<std::greater_equal<T>> {
-protected:
-    void describe(std::ostream& o, T const& expected) const {
-        o << "greater than or equal to " << expected;
+    M const& matcher() const {
+        return matcher_;
+    }
+
+    friend writer& operator<<(writer& o, incremental_matcher const& stream) {
+        o << stream.matcher_ << " after " << stream.count_ << (stream.count_ == 1 ? " item" : " items");
+        if (stream.state_.result() == verdict::pending)
+            o << ", still pending";
+        writer evidence;
+        if (stream.state_.describe(evidence))
+            o << ", " << evidence.str();
+        return o;
+    }
+
+    friend std::ostream& operator<<(std::ostream& o, incremental_matcher const& stream) {
+        return detail::stream_out(o, stream);
     }
+
+private:
+    M matcher_;
+    detail::stream_state<M, T> state_;
+    std::uint64_t count_;
+    bool finished_;
 };
 
-template<typename T>
-Matcher<GreaterThanOrEqual<T>,T> greaterThanOrEqualTo(T const& value) {
-    return Matcher<GreaterThanOrEqual<T>,T>(value);
+template<typename T, typename Policy, typename E>
+incremental_matcher<T, Matcher<Policy, E>> incremental(Matcher<Policy, E> matcher) {
+    return incremental_matcher<T, Matcher<Policy, E>>(std::move(matcher));
 }
 
-template<typename T>
-struct LessThanOrEqual : OrderingComparison<std::less_equal<T>> {
+// passes once a stream has matched: a stream still pending, finish() not
+// called on it, hasn't
+struct Holds_ {
+    static constexpr match_cost cost = cost_cheap;
+
 protected:
-    void describe(std::ostream& o, T const& expected) const {
-        o << "less than or equal to " << expected;
+    template<typename T, typename M>
+    bool matches(incremental_matcher<T, M> const& stream) const {
+        return stream.state() == verdict::matched;
+    }
+
+    void describe(writer& o) const {
+        o << "a stream which matched";
     }
 };
 
-template<typename T>
-Matcher<LessThanOrEqual<T>,T> lessThanOrEqualTo(T const& value) {
-    return Matcher<LessThanOrEqual<T>,T>(value);
+using Holds = Matcher<Holds_>;
+
+constexpr Holds holds() {
+    return Holds();
 }
 
+/* the failure messages of equalTo on the commonest types are instantiated
+ * in libmatcha, rather than in every test file asserting with them
+ */
+#if defined(MATCHA_LIBRARY)
+#if defined(MATCHA_SOURCE)
+#define MATCHA_EXTERN_TEMPLATE template
+#else
+#define MATCHA_EXTERN_TEMPLATE extern template
+#endif
+
+namespace detail {
+
+MATCHA_EXTERN_TEMPLATE writer& describe_failure(writer&, int const&, Matcher<IsEqual, int> const&);
+MATCHA_EXTERN_TEMPLATE writer& describe_failure(writer&, double const&, Matcher<IsEqual, double> const&);
+MATCHA_EXTERN_TEMPLATE writer& describe_failure(writer&, std::string const&, Matcher<IsEqual, std::string> const&);
+MATCHA_EXTERN_TEMPLATE writer& describe_failure(writer&, std::vector<int> const&,
+                                                Matcher<IsEqual, std::vector<int>> const&);
+
+} // namespace detail
+
+#undef MATCHA_EXTERN_TEMPLATE
+#endif // MATCHA_LIBRARY
+
 } // namespace matcha
 
+#if !defined(MATCHA_LIBRARY)
+#include "matcha-inl.hpp"
+#endif
+
 #endif // _MATCHA_H_
@@ -16,6 +16,8 @@
 #include <set>
 #include <unordered_set>
 #include <valarray>
+#include <streambuf>
+#include <algorithm>
 
 namespace pretty_print
 {
@@ -179,6 +181,122 @@ namespace pretty_print
     template<typename T1, typename T2> const delimiters_values<wchar_t> delimiters< ::std::pair<T1, T2>, wchar_t>::values = { L"(", L", ", L")" };
 
 
+    // Bounds on what is printed of a container, 0 meaning unbounded. Containers with more
+    // than max_elements items print their head and tail around an ellipsis, as in
+    // "[1, 2, 3, ... 9999998, 9999999]"; those nested deeper than max_depth print as "[...]";
+    // a container printed at the top level stops after max_bytes characters with " ...".
+    // Set them before printing from several threads.
+
+    struct print_limits
+    {
+        std::size_t max_elements;
+        std::size_t max_depth;
+        std::size_t max_bytes;
+    };
+
+    inline print_limits & limits()
+    {
+        static print_limits values = { 64, 8, 1 << 16 };
+        return values;
+    }
+
+
+    // Per-thread state of the container being printed, shared with the containers nested in it.
+
+    struct print_state
+    {
+        std::size_t depth;
+        const bool * exhausted;
+        const print_limits * bounds;    // in place of limits(), when set
+
+        static print_state & current()
+        {
+            static thread_local print_state state = { 0, NULL, NULL };
+            return state;
+        }
+    };
+
+
+    // Lifts all limits off what the current thread prints while it is in scope, for output which
+    // has to be complete, leaving limits() to the other threads.
+
+    class unbounded
+    {
+    public:
+        unbounded()
+        : _state(print_state::current()), _saved(_state.bounds)
+        {
+            static const print_limits none = { 0, 0, 0 };
+            _state.bounds = &none;
+        }
+
+        ~unbounded() { _state.bounds = _saved; }
+
+    private:
+        unbounded(const unbounded &);
+        unbounded & operator=(const unbounded &);
+
+        print_state & _state;
+        const print_limits * _saved;
+    };
+
+
+    // Stream buffer forwarding the first max_bytes characters to another one and dropping the rest.
+
+    template<typename TChar, typename TCharTraits>
+    class bounded_streambuf : public std::basic_streambuf<TChar, TCharTraits>
+    {
+    public:
+        typedef std::basic_streambuf<TChar, TCharTraits> streambuf_type;
+        typedef typename TCharTraits::int_type int_type;
+
+        bounded_streambuf(streambuf_type * target, std::size_t max_bytes)
+        : _target(target), _left(max_bytes), _exhausted(false)
+        {
+        }
+
+        const bool & exhausted() const { return _exhausted; }
+
+    protected:
+        int_type overflow(int_type c)
+        {
+            if (TCharTraits::eq_int_type(c, TCharTraits::eof()))
+                return TCharTraits::not_eof(c);
+
+            if (_left == 0)
+            {
+                _exhausted = true;
+                return c;
+            }
+
+            --_left;
+            return _target->sputc(TCharTraits::to_char_type(c));
+        }
+
+        std::streamsize xsputn(const TChar * s, std::streamsize n)
+        {
+            const std::size_t k = std::min<std::size_t>(n, _left);
+
+            if (k < static_cast<std::size_t>(n))
+                _exhausted = true;
+
+            _left -= k;
+            _target->sputn(s, k);
+            return n;
+        }
+
+        int sync()
+        {
+            return _target->pubsync();
+        }
+
+    private:
+        streambuf_type * _target;
+        std::size_t _left;
+        bool _exhausted;
+    };
+
+
     // Functor to print containers. You can use this directly if you want to specificy a non-default delimiters type.
 
     template<typename T, typename TChar = char, typename TCharTraits = ::std::char_traits<TChar>, typename TDelimiters = delimiters<T, TChar>>
@@ -189,45 +307,196 @@ namespace pretty_print
         typedef std::basic_ostream<TChar, TCharTraits> ostream_type;
 
         print_container_helper(const T & container)
-        : _container(container)
+        : _container(container), _first(0), _count(0), _window(false)
+        {
+        }
+
+        // Prints only the count items from position first, with ellipses for those left out.
+
+        print_container_helper(const T & container, std::size_t first, std::size_t count)
+        : _container(container), _first(first), _count(count), _window(true)
         {
         }
 
         inline void operator()(ostream_type & stream) const
+        {
+            print_state & state = print_state::current();
+            const print_limits bounds = state.bounds != NULL ? *state.bounds : limits();
+
+            if (state.depth != 0 || bounds.max_bytes == 0)
+            {
+                print(stream, state, bounds);
+                return;
+            }
+
+            // the outermost container bounds the output of everything nested in it
+            bounded_streambuf<TChar, TCharTraits> buffer(stream.rdbuf(), bounds.max_bytes);
+
+            struct redirect
+            {
+                std::ios_base::iostate saved;
+                ostream_type & stream;
+                std::basic_streambuf<TChar, TCharTraits> * target;
+                print_state & state;
+                ~redirect() { stream.rdbuf(target); stream.setstate(saved); state.exhausted = NULL; }
+            };
+
+            {
+                redirect guard = { stream.rdstate(), stream, stream.rdbuf(&buffer), state };
+                state.exhausted = &buffer.exhausted();
+                print(stream, state, bounds);
+            }
+
+            if (buffer.exhausted())
+                stream << " ...";
+        }
+
+    private:
+        void print(ostream_type & stream, print_state & state, const print_limits & bounds) const
         {
             if (delimiters_type::values.prefix != NULL)
                 stream << delimiters_type::values.prefix;
 
+            if (bounds.max_depth != 0 && state.depth >= bounds.max_depth)
+            {
+                stream << "...";
+            }
+            else
             {
+                ++state.depth;
+                struct leave { std::size_t & depth; ~leave() { --depth; } } guard = { state.depth };
+
                 using std::begin;
                 using std::end;
 
-                auto it = begin(_container);
-                const auto the_end = end(_container);
+                typedef decltype(begin(_container)) iterator;
 
-                if (it != the_end)
-                {
-                    for ( ; ; )
-                    {
-                        stream << *it;
-
-                    if (++it == the_end) break;
-
-                    if (delimiters_type::values.delimiter != NULL)
-                        stream << delimiters_type::values.delimiter;
-                    }
-                }
+                if (_window)
+                    print_window(stream, state, begin(_container), end(_container));
+                else
+                    print_items(stream, state, bounds.max_elements, begin(_container), end(_container),
+                                typename std::iterator_traits<iterator>::iterator_category());
             }
 
             if (delimiters_type::values.postfix != NULL)
                 stream << delimiters_type::values.postfix;
         }
 
-    private:
+        static bool exhausted(const print_state & state)
+        {
+            return state.exhausted != NULL && *state.exhausted;
+        }
+
+        template<typename It>
+        static It print_run(ostream_type & stream, const print_state & state, It it, It the_end, std::size_t count)
+        {
+            for (std::size_t i = 0; i != count && it != the_end && !exhausted(state); ++i, ++it)
+            {
+                if (i != 0 && delimiters_type::values.delimiter != NULL)
+                    stream << delimiters_type::values.delimiter;
+
+                stream << *it;
+            }
+            return it;
+        }
+
+        static void print_ellipsis(ostream_type & stream)
+        {
+            if (delimiters_type::values.delimiter != NULL)
+                stream << delimiters_type::values.delimiter;
+
+            stream << "...";
+        }
+
+        // Without a way back from the end, only the head is printed.
+
+        template<typename It>
+        static void print_items(ostream_type & stream, const print_state & state, std::size_t max_elements,
+                                It it, It the_end, std::input_iterator_tag)
+        {
+            if (max_elements == 0)
+                max_elements = std::size_t(-1);
+
+            it = print_run(stream, state, it, the_end, max_elements);
+
+            if (it != the_end && !exhausted(state))
+                print_ellipsis(stream);
+        }
+
+        template<typename It>
+        static void print_items(ostream_type & stream, const print_state & state, std::size_t max_elements,
+                                It it, It the_end, std::bidirectional_iterator_tag)
+        {
+            if (max_elements == 0)
+            {
+                print_run(stream, state, it, the_end, std::size_t(-1));
+                return;
+            }
+
+            // find where the tail starts, walking back from the end at most max_elements / 2 items
+            const std::size_t head = max_elements - max_elements / 2;
+            It tail = the_end;
+            std::size_t tail_size = 0;
+
+            It probe = it;
+            std::size_t seen = 0;
+            for ( ; seen != max_elements && probe != the_end; ++seen)
+                ++probe;
+
+            if (probe == the_end)
+            {
+                print_run(stream, state, it, the_end, seen);
+                return;
+            }
+
+            for ( ; tail_size != max_elements / 2; ++tail_size)
+                --tail;
+
+            print_run(stream, state, it, the_end, head);
+
+            if (exhausted(state))
+                return;
+
+            print_ellipsis(stream);
+
+            if (tail_size != 0)
+            {
+                stream << " ";
+                print_run(stream, state, tail, the_end, tail_size);
+            }
+        }
+
+        template<typename It>
+        void print_window(ostream_type & stream, const print_state & state, It it, It the_end) const
+        {
+            for (std::size_t i = 0; i != _first && it != the_end; ++i)
+                ++it;
+
+            if (_first != 0)
+                stream << "... ";
+
+            it = print_run(stream, state, it, the_end, _count);
+
+            if (it != the_end && !exhausted(state))
+                print_ellipsis(stream);
+        }
+
         const T & _container;
+        std::size_t _first;
+        std::size_t _count;
+        bool _window;
     };
 
 
+    // Prints the count items of a container from position first, as in "[... 4, 5, 6, ...]".
+
+    template<typename T>
+    inline print_container_helper<T> window(const T & container, std::size_t first, std::size_t count)
+    {
+        return print_container_helper<T>(container, first, count);
+    }
+
+
     // Type-erasing helper class for easy use of custom delimiters.
     // Requires TCharTraits = std::char_traits<TChar> and TChar = char or wchar_t, and MyDelims needs to be defined for TChar.
     // Usage: "cout << pretty_print::custom_delims<MyDelims>(x)".
@@ -0,0 +1,27 @@
+/* vim: set sw=4 ts=4 et : */
+/* matcha.cpp: libmatcha, for tests built with MATCHA_LIBRARY
+ *
+ * Copyright (C) 2014 Alexandre Moreno
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#if !defined(MATCHA_LIBRARY)
+#define MATCHA_LIBRARY
+#endif
+
+// the common instantiations declared extern by matcha.hpp are defined here
+#define MATCHA_SOURCE
+
+#include "matcha.hpp"
+#include "matcha-inl.hpp"